@@ -0,0 +1,908 @@
+#ifndef OT_HELIX_OT_H
+#define OT_HELIX_OT_H
+
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+#include <cmath>
+#include <gmpxx.h>
+#include <ctime>
+#include <cstdlib>
+#include <random>
+#include <chrono>
+#include <algorithm>
+#include "../common/block.h"
+#include "../common/xor_kernel.h"
+#include "../common/tbcs.h"
+#include "../common/batch.h"
+#include "../common/prg.h"
+#include "../common/lazy_pads.h"
+#include "../common/database.h"
+#include "../common/spsc_ring.h"
+#include "../common/arena.h"
+#include "../common/offline_pool.h"
+#include "../common/trace.h"
+
+// Helix OT (1-out-of-n OT): the phase functions, and Sender/Receiver objects that hold one
+// party's state across the phases. main.cpp is a timing driver built on top of this header.
+namespace helix {
+
+using namespace std;
+
+// Function to generate a random big integer with a specified number of bits
+inline mpz_class generate_random_bigint(gmp_randclass& rng, int num_bits) {
+  return rng.get_z_bits(num_bits);
+}
+
+inline void generate_random_bigint(gmp_randclass& rng, int num_bits, mpz_class& out) {
+  out = rng.get_z_bits(num_bits);
+}
+
+// Fixed-width variant: num_bits must not exceed Bits
+template <unsigned Bits>
+void generate_random_bigint(gmp_randclass& rng, int num_bits, Block<Bits>& out) {
+  out.assign(rng.get_z_bits(num_bits));
+}
+
+// Function to perform the TBCS algorithm with big integers
+template <typename T>
+bool TBCS(int database_size, T* tree, const vector<int>& b);
+
+// Packed form: b is the controlled-swap word from gen_query
+template <typename T>
+bool TBCS(int database_size, T* tree, uint64_t b) {
+  if (b >= uint64_t(database_size)) {
+    cerr << "\n Error: The share word must have log2(length of m) bits." << endl;
+    return false;
+  }
+  tbcs_permute(tree, database_size, b);
+  return true;
+}
+
+// Copying form: returns the permuted messages and leaves m untouched
+inline vector<mpz_class> TBCS(int database_size, const vector<mpz_class>& m, const vector<int>& b) {
+  vector<mpz_class> tree = m;
+  if (!TBCS(database_size, tree.data(), b)) {
+    return {}; // Return an empty vector to indicate an error
+  }
+  return tree;
+}
+
+// TBCS over one row of a flat buffer; the n messages at tree are permuted in place
+template <typename T>
+bool TBCS(int database_size, T* tree, const vector<int>& b) {
+  uint64_t mask;
+  if (!tbcs_mask(database_size, b, mask)) {
+    return false;
+  }
+  tbcs_permute(tree, database_size, mask);
+  return true;
+}
+
+///-------  Phase 1: Setup
+// Pads are expanded from a 128-bit seed by the counter-mode PRG (AES-NI, or ChaCha20 where
+// AES-NI is missing): pad r[j][i] is read from stream j at offset i, so invocations and chunks
+// of them are filled in parallel, and a fixed seed gives the same pads for any thread count
+inline void setup(int number_of_OT, int n, unsigned int bit_size, vector<vector<mpz_class>>& random_numbers_collection, const PrgSeed& seed = random_prg_seed()) {
+  OT_TRACE_SCOPE(kTraceSetup, uint64_t(number_of_OT) * n * ((bit_size + 7) / 8));
+  // Declare the outer vector to hold 'number_of_OT' vectors of random numbers
+  random_numbers_collection.assign(number_of_OT, vector<mpz_class>(n));
+  const Prg prg(seed);
+  const size_t words = (bit_size + 63) / 64;
+  batch_for(ThreadPool::global(), number_of_OT, n, [&](size_t j, size_t lo, size_t hi) {
+    const size_t batch = 256; // numbers expanded per PRG call
+    vector<uint64_t> buf(batch * words);
+    vector<mpz_class>& v = random_numbers_collection[j];
+    for (size_t begin = lo; begin < hi; begin += batch) {
+      size_t len = min(batch, hi - begin);
+      prg.fill(j, begin * words, buf.data(), len * words);
+      for (size_t i = 0; i < len; ++i) {
+        // Import the words and keep the low bit_size bits
+        mpz_import(v[begin + i].get_mpz_t(), words, -1, sizeof(uint64_t), 0, 0, &buf[i * words]);
+        mpz_fdiv_r_2exp(v[begin + i].get_mpz_t(), v[begin + i].get_mpz_t(), bit_size);
+      }
+    }
+  });
+}
+
+// Fixed-width setup: all number_of_OT x n pads live in one flat buffer, which the PRG writes
+// directly in large runs
+template <unsigned Bits>
+void setup(int number_of_OT, int n, unsigned int bit_size, const MatrixView<Block<Bits>>& random_numbers_collection, const PrgSeed& seed = random_prg_seed()) {
+  OT_TRACE_SCOPE(kTraceSetup, uint64_t(number_of_OT) * n * sizeof(Block<Bits>));
+  const Prg prg(seed);
+  batch_for(ThreadPool::global(), number_of_OT, n, [&](size_t j, size_t lo, size_t hi) {
+    prg.fill_blocks(j, lo, random_numbers_collection[j] + lo, hi - lo);
+  });
+}
+
+template <unsigned Bits>
+void setup(int number_of_OT, int n, unsigned int bit_size, BlockMatrix<Bits>& random_numbers_collection, const PrgSeed& seed = random_prg_seed()) {
+  random_numbers_collection.resize(number_of_OT, n);
+  setup(number_of_OT, n, bit_size, random_numbers_collection.view(), seed);
+}
+
+// Seed-compressed setup: only the seed is kept; pads are regenerated where they are used
+template <unsigned Bits>
+void setup(int number_of_OT, int n, unsigned int bit_size, LazyPads<Bits>& random_numbers_collection, const PrgSeed& seed = random_prg_seed()) {
+  OT_TRACE_SCOPE(kTraceSetup, 0);
+  random_numbers_collection = LazyPads<Bits>(number_of_OT, n, seed);
+}
+
+//geenrates a vector of random integers
+inline vector<int> generateRandomIntegers(int number_of_OT, int n) {
+  // Vector to hold the collection of random integers
+  vector<int> random_integers;
+  random_integers.reserve(number_of_OT); // Reserve space for efficiency
+  // Seed the random number generator with a unique seed
+  unsigned seed = chrono::system_clock::now().time_since_epoch().count();
+  mt19937 rng(seed);
+  uniform_int_distribution<int> dist(0, n); // Range [0, n] inclusive
+  // Generate 'number_of_OT' random integers
+  for (int i = 0; i < number_of_OT; ++i) {
+    random_integers.push_back(dist(rng));
+  }
+  return random_integers;
+}
+
+// XOR-based secret sharing of each index as one packed word: p_shares[i] is uniform over
+// [0, 2^bits) and the returned s_shares[i] = p_shares[i] ^ secret_index[i]. Random words are
+// read from the PRG (word i of stream 0), so a fixed seed gives the same shares for any
+// thread count.
+//
+// share_words is the half that does not depend on the indices, so it can run offline;
+// derandomize_shares is the online half.
+inline void share_words(int number_of_OT, int bits, uint64_t* p_shares, const PrgSeed& seed) {
+  const uint64_t low = bits >= 64 ? ~uint64_t(0) : (uint64_t(1) << bits) - 1;
+  const Prg prg(seed);
+  ThreadPool::global().parallel_for(0, number_of_OT, 4096, [&](size_t lo, size_t hi) {
+    prg.fill(0, lo, p_shares + lo, hi - lo);
+    for (size_t i = lo; i < hi; i++){
+      p_shares[i] &= low;
+    }
+  });
+}
+
+inline void derandomize_shares(int number_of_OT, const int* secret_index, const uint64_t* p_shares, uint64_t* s_shares) {
+  for (int i = 0; i < number_of_OT; i++){
+    s_shares[i] = p_shares[i] ^ uint64_t(secret_index[i]);
+  }
+}
+
+inline void SS(int number_of_OT, const int* secret_index, int bits, uint64_t* p_shares, uint64_t* s_shares, const PrgSeed& seed){
+  share_words(number_of_OT, bits, p_shares, seed);
+  derandomize_shares(number_of_OT, secret_index, p_shares, s_shares);
+}
+
+inline vector<uint64_t> SS(int number_of_OT, const vector<int>& secret_index, int bits, vector<uint64_t> &p_shares, const PrgSeed& seed = random_prg_seed()){
+  vector<uint64_t> s_shares(number_of_OT);
+  p_shares.resize(number_of_OT);
+  SS(number_of_OT, secret_index.data(), bits, p_shares.data(), s_shares.data(), seed);
+  return s_shares;
+}
+
+
+//------- Phase 2: GenQuery
+// Each invocation's query is a pair of log2(n)-bit words whose XOR is the index. Bit k of a
+// share word is the TBCS control bit of the tree level that flips bit k of a leaf index, so
+// the words are the TBCS masks themselves.
+inline vector<uint64_t> gen_query(int n, int number_of_OT, const vector<int>& indices, int bit_size, vector<uint64_t>& share2, const PrgSeed& seed = random_prg_seed()) {
+    OT_TRACE_SCOPE(kTraceGenQuery, uint64_t(number_of_OT) * sizeof(uint64_t));
+    if (bit_size > 64) {
+      cerr << "\n Error: log2(n) must be at most 64." << endl;
+      return {};
+    }
+    // share1 = random word ^ index, share2 = random word
+    return SS(number_of_OT, indices, bit_size, share2, seed);
+  }
+
+// Same, into caller-provided words: share1 and share2 hold number_of_OT each
+inline bool gen_query(int n, int number_of_OT, const int* indices, int bit_size, uint64_t* share1, uint64_t* share2, const PrgSeed& seed) {
+  OT_TRACE_SCOPE(kTraceGenQuery, uint64_t(number_of_OT) * sizeof(uint64_t));
+  if (bit_size > 64) {
+    cerr << "\n Error: log2(n) must be at most 64." << endl;
+    return false;
+  }
+  SS(number_of_OT, indices, bit_size, share2, share1, seed);
+  return true;
+}
+
+// Checks that every share word is a valid TBCS mask for n messages
+inline bool check_shares(int n, const uint64_t* shares, size_t count) {
+  for (size_t j = 0; j < count; ++j) {
+    if (shares[j] >= uint64_t(n)) {
+      cerr << "\n Error: The share word must have log2(length of m) bits." << endl;
+      return false;
+    }
+  }
+  return true;
+}
+
+inline bool check_shares(int n, const vector<uint64_t>& shares) {
+  return check_shares(n, shares.data(), shares.size());
+}
+
+// Phase 3: Gen response
+inline vector<vector<mpz_class>> gen_res_(int number_of_OT, int n, const vector<mpz_class>& vec1, const vector<vector<mpz_class>>& vec2, const vector<uint64_t>& share1) {
+  OT_TRACE_SCOPE(kTraceGenRes, 0);
+  vector<vector<mpz_class>> result(number_of_OT);
+  if (!check_shares(n, share1)) {
+    return {};
+  }
+  const vector<uint64_t>& masks = share1;
+  ThreadPool::global().parallel_for(0, number_of_OT, 1, [&](size_t lo, size_t hi) {
+    for (size_t j = lo; j < hi; ++j) {
+      result[j].resize(n);
+      for (size_t i = 0; i < n; ++i) {
+        // Perform component-wise XOR and store directly in result[j][i]
+        result[j][i] = vec1[i] ^ vec2[j][i];
+      }
+      // Apply the TBCS transformation after the XOR operation
+      OT_TRACE_SCOPE(kTraceTbcs, 0);
+      tbcs_permute(result[j].data(), n, masks[j]);
+    }
+  });
+  return result;
+}
+
+// Seed-compressed pads are expanded in pieces of this many bytes, into a stack buffer that
+// stays in L1
+const size_t kPadScratchBytes = 16 * 1024;
+
+// The scratch mask_and_permute gets for Pads: none for stored pads, an uninitialized
+// kPadScratchBytes stage for seed-compressed ones
+template <unsigned Bits, typename Pads>
+struct PadScratch {
+  Block<Bits>* data() { return nullptr; }
+  size_t size() const { return 0; }
+};
+
+template <unsigned Bits>
+struct PadScratch<Bits, LazyPads<Bits>> : BlockStage<Bits, kPadScratchBytes / sizeof(Block<Bits>)> {};
+
+// Writes output positions [lo, hi) of invocation j's response to dst[0, hi - lo): the masked
+// messages whose TBCS destination falls there. Stored pads are XORed straight from m into the response row;
+// seed-compressed pads are expanded into scratch (scratch_len blocks) first.
+template <unsigned Bits>
+void mask_and_permute(Block<Bits>* dst, const Block<Bits>* m, const BlockMatrix<Bits>& r, size_t j, size_t lo, size_t hi, uint64_t mask, Block<Bits>*, size_t) {
+  tbcs_xor_gather(dst, m, r[j], lo, hi, mask);
+}
+
+template <unsigned Bits>
+void mask_and_permute(Block<Bits>* dst, const Block<Bits>* m, const MatrixView<Block<Bits>>& r, size_t j, size_t lo, size_t hi, uint64_t mask, Block<Bits>*, size_t) {
+  tbcs_xor_gather(dst, m, r[j], lo, hi, mask);
+}
+
+template <unsigned Bits>
+void mask_and_permute(Block<Bits>* dst, const Block<Bits>* m, const LazyPads<Bits>& r, size_t j, size_t lo, size_t hi, uint64_t mask, Block<Bits>* scratch, size_t scratch_len) {
+  auto expand = [&](size_t src, Block<Bits>* out, size_t len) { r.expand(j, src, out, len); };
+  tbcs_xor_gather(dst, m, expand, lo, hi, mask, scratch, scratch_len);
+}
+
+// mpz_class path over a mapped database: records are imported as they are read
+template <unsigned Bits>
+vector<vector<mpz_class>> gen_res_(int number_of_OT, int n, const MappedDatabase<Bits>& vec1, const vector<vector<mpz_class>>& vec2, const vector<uint64_t>& share1) {
+  OT_TRACE_SCOPE(kTraceGenRes, uint64_t(number_of_OT) * n * sizeof(Block<Bits>));
+  vector<vector<mpz_class>> result(number_of_OT, vector<mpz_class>(n));
+  if (!check_shares(n, share1)) {
+    return {};
+  }
+  const vector<uint64_t>& masks = share1;
+  ThreadPool::global().parallel_for(0, number_of_OT, 1, [&](size_t lo, size_t hi) {
+    for (size_t j = lo; j < hi; ++j) {
+      OT_TRACE_SCOPE(kTraceTbcs, n * sizeof(Block<Bits>));
+      for (size_t i = 0; i < n; ++i) {
+        result[j][i ^ masks[j]] = vec1[i].to_mpz() ^ vec2[j][i];
+      }
+    }
+  });
+  return result;
+}
+
+// One receiver's batch in a multi-query GenRes: its pads and its share1 (number_of_OT words)
+template <typename Pads>
+struct PendingQuery {
+  const Pads* pads;
+  int number_of_OT;
+  const uint64_t* share1;
+};
+
+// Engines for the shared scan below. HelixDynamic serves any power-of-two n; HelixOT serves
+// n = 2^LogN only, with the tree depth and size as compile-time constants, so the share
+// check is one shift and the stored-pad gather is specialized (tbcs_xor_gather_fixed).
+template <unsigned Bits>
+struct HelixDynamic {
+  int n;
+
+  explicit HelixDynamic(int n) : n(n) {}
+
+  size_t size() const { return size_t(n); }
+  bool check_shares(const uint64_t* shares, size_t count) const { return helix::check_shares(n, shares, count); }
+
+  template <typename Pads>
+  void mask_and_permute(Block<Bits>* dst, const Block<Bits>* m, const Pads& r, size_t j, size_t lo, size_t hi, uint64_t mask, Block<Bits>* scratch, size_t scratch_len) const {
+    helix::mask_and_permute(dst, m, r, j, lo, hi, mask, scratch, scratch_len);
+  }
+};
+
+template <int LogN, unsigned Bits>
+struct HelixOT {
+  static_assert(LogN >= 1 && LogN < 64, "n = 2^LogN needs 1 <= LogN < 64");
+  static const int kDepth = LogN;
+  static const size_t kN = size_t(1) << LogN;
+
+  size_t size() const { return kN; }
+
+  bool check_shares(const uint64_t* shares, size_t count) const {
+    for (size_t j = 0; j < count; ++j) {
+      if ((shares[j] >> LogN) != 0) {
+        cerr << "\n Error: The share word must have log2(length of m) bits." << endl;
+        return false;
+      }
+    }
+    return true;
+  }
+
+  void mask_and_permute(Block<Bits>* dst, const Block<Bits>* m, const BlockMatrix<Bits>& r, size_t j, size_t lo, size_t hi, uint64_t mask, Block<Bits>*, size_t) const {
+    tbcs_xor_gather_fixed<LogN>(dst, m, r[j], lo, hi, mask);
+  }
+
+  void mask_and_permute(Block<Bits>* dst, const Block<Bits>* m, const MatrixView<Block<Bits>>& r, size_t j, size_t lo, size_t hi, uint64_t mask, Block<Bits>*, size_t) const {
+    tbcs_xor_gather_fixed<LogN>(dst, m, r[j], lo, hi, mask);
+  }
+
+  // Seed-compressed pads are expanded piece by piece whatever n is
+  void mask_and_permute(Block<Bits>* dst, const Block<Bits>* m, const LazyPads<Bits>& r, size_t j, size_t lo, size_t hi, uint64_t mask, Block<Bits>* scratch, size_t scratch_len) const {
+    helix::mask_and_permute(dst, m, r, j, lo, hi, mask, scratch, scratch_len);
+  }
+};
+
+// Shared-scan sender: m is read once per batch in cache-sized chunks, and each chunk is
+// masked and permuted for every invocation while it is resident. A chunk of 2^k messages
+// lands on one aligned block of 2^k output positions, so each invocation's piece of the
+// response is written in place. Pads is BlockMatrix<Bits>, a view of stored pads, or
+// LazyPads<Bits>. The invocations of every query are laid end to end and scanned together, so
+// m is read once for all receivers.
+//
+// This form writes query k's response into out[k], a number_of_OT x n view, and keeps the
+// flat invocation list in invocations, so a caller that reuses both allocates nothing.
+// Returns false, with nothing written, if any share is invalid.
+template <typename Engine, unsigned Bits, typename Pads>
+bool gen_res_scan_with(const Engine& engine, const Block<Bits>* m, const PendingQuery<Pads>* queries, const MatrixView<Block<Bits>>* out, size_t count, vector<QueryInvocation>& invocations) {
+  invocations.clear();
+  for (size_t k = 0; k < count; ++k) {
+    if (!engine.check_shares(queries[k].share1, queries[k].number_of_OT)) {
+      return false;
+    }
+    for (int j = 0; j < queries[k].number_of_OT; ++j) {
+      QueryInvocation invocation = {uint32_t(k), uint32_t(j)};
+      invocations.push_back(invocation);
+    }
+  }
+  const size_t n = engine.size();
+  OT_TRACE_SCOPE(kTraceGenRes, invocations.size() * n * sizeof(Block<Bits>));
+  const size_t chunk = scan_chunk(n, sizeof(Block<Bits>));
+  scan_for(ThreadPool::global(), invocations.size(), n, chunk, [&](size_t lo, size_t hi, size_t g_lo, size_t g_hi) {
+    PadScratch<Bits, Pads> scratch;
+    OT_TRACE_SCOPE(kTraceTbcs, (g_hi - g_lo) * (hi - lo) * sizeof(Block<Bits>));
+    for (size_t g = g_lo; g < g_hi; ++g) {
+      const PendingQuery<Pads>& query = queries[invocations[g].query];
+      const size_t j = invocations[g].j;
+      const uint64_t mask = query.share1[j];
+      // the chunk's destination: its own position with the high bits of the mask flipped
+      size_t dst = lo ^ (mask & ~uint64_t(chunk - 1));
+      engine.mask_and_permute(out[invocations[g].query][j] + dst, m, *query.pads, j, dst, dst + (hi - lo), mask, scratch.data(), scratch.size());
+    }
+  });
+  return true;
+}
+
+// Picks the compiled-in HelixOT engine for the deployment sizes n = 16, 256, 4096 and 65536,
+// and the generic one for every other n
+template <unsigned Bits, typename Pads>
+bool gen_res_scan(const Block<Bits>* m, int n, const PendingQuery<Pads>* queries, const MatrixView<Block<Bits>>* out, size_t count, vector<QueryInvocation>& invocations) {
+  switch (n) {
+    case 16: return gen_res_scan_with(HelixOT<4, Bits>(), m, queries, out, count, invocations);
+    case 256: return gen_res_scan_with(HelixOT<8, Bits>(), m, queries, out, count, invocations);
+    case 4096: return gen_res_scan_with(HelixOT<12, Bits>(), m, queries, out, count, invocations);
+    case 65536: return gen_res_scan_with(HelixOT<16, Bits>(), m, queries, out, count, invocations);
+  }
+  return gen_res_scan_with(HelixDynamic<Bits>(n), m, queries, out, count, invocations);
+}
+
+// Responses in query order, or empty if any share is invalid
+template <unsigned Bits, typename Pads>
+vector<BlockMatrix<Bits>> gen_res_scan(const Block<Bits>* m, int n, const vector<PendingQuery<Pads>>& queries) {
+  vector<BlockMatrix<Bits>> result(queries.size());
+  vector<MatrixView<Block<Bits>>> out(queries.size());
+  for (size_t k = 0; k < queries.size(); ++k) {
+    result[k].resize(queries[k].number_of_OT, n);
+    out[k] = result[k].view();
+  }
+  vector<QueryInvocation> invocations;
+  if (!gen_res_scan(m, n, queries.data(), out.data(), queries.size(), invocations)) {
+    return vector<BlockMatrix<Bits>>();
+  }
+  return result;
+}
+
+template <unsigned Bits, typename Pads>
+BlockMatrix<Bits> gen_res_scan(const Block<Bits>* m, int number_of_OT, int n, const Pads& r, const vector<uint64_t>& share1) {
+  if (share1.size() < size_t(number_of_OT)) {
+    cerr << "\n Error: share1 must hold one word per invocation." << endl;
+    return BlockMatrix<Bits>();
+  }
+  vector<PendingQuery<Pads>> queries(1);
+  queries[0].pads = &r;
+  queries[0].number_of_OT = number_of_OT;
+  queries[0].share1 = share1.data();
+  vector<BlockMatrix<Bits>> result = gen_res_scan(m, n, queries);
+  return result.empty() ? BlockMatrix<Bits>() : move(result[0]);
+}
+
+template <unsigned Bits, typename Pads>
+BlockMatrix<Bits> gen_res_(int number_of_OT, int n, const BlockVector<Bits>& vec1, const Pads& vec2, const vector<uint64_t>& share1) {
+  return gen_res_scan(vec1.data(), number_of_OT, n, vec2, share1);
+}
+
+// Streams a memory-mapped database; records go from the mapped pages straight into the XOR
+template <unsigned Bits, typename Pads>
+BlockMatrix<Bits> gen_res_(int number_of_OT, int n, const MappedDatabase<Bits>& vec1, const Pads& vec2, const vector<uint64_t>& share1) {
+  return gen_res_scan(vec1.data(), number_of_OT, n, vec2, share1);
+}
+
+// Streaming sender for the pipelined mode: the response is produced row by row in ring-slot
+// sized chunks of output positions on the calling thread and handed to the receiver's
+// obli_filter_stream through ring, so no more than the ring's slots are ever held. The slot
+// length must be a power of two (ring_slot_len). Closes the ring when done; returns false,
+// with the ring closed and empty, if share1 is invalid.
+template <unsigned Bits, typename Pads>
+bool gen_res_stream(const Block<Bits>* m, int number_of_OT, int n, const Pads& r, const vector<uint64_t>& share1, SpscRing<Block<Bits>>& ring) {
+  OT_TRACE_SCOPE(kTraceGenRes, uint64_t(number_of_OT) * n * sizeof(Block<Bits>));
+  if (!check_shares(n, share1)) {
+    ring.close();
+    return false;
+  }
+  const size_t chunk = min(ring.slot_len(), size_t(n));
+  PadScratch<Bits, Pads> scratch;
+  for (size_t j = 0; j < size_t(number_of_OT); ++j) {
+    for (size_t lo = 0; lo < size_t(n); lo += chunk) {
+      size_t hi = min(size_t(n), lo + chunk);
+      Block<Bits>* slot = ring.acquire();
+      OT_TRACE_SCOPE(kTraceTbcs, (hi - lo) * sizeof(Block<Bits>));
+      mask_and_permute(slot, m, r, j, lo, hi, share1[j], scratch.data(), scratch.size());
+      RingChunk tag = {j, lo, hi - lo};
+      ring.publish(tag);
+    }
+  }
+  ring.close();
+  return true;
+}
+
+// Phase 4: Oblivious Filter
+inline vector<mpz_class> obli_filter(int number_of_OT, int n, const vector<vector<mpz_class>>& vec, const vector<uint64_t>& share2) {
+  OT_TRACE_SCOPE(kTraceFilter, 0);
+  vector<mpz_class> result(number_of_OT);
+  if (!check_shares(n, share2)) {
+    return {};
+  }
+  const vector<uint64_t>& masks = share2;
+  ThreadPool::global().parallel_for(0, number_of_OT, 1024, [&](size_t lo, size_t hi) {
+    for (size_t i = lo; i < hi; i++) {
+      // Select the element TBCS would move to position 0
+      result[i] = vec[i][tbcs_select(0, masks[i])];
+    }
+  });
+  return result;
+}
+
+// Into caller-provided storage: result holds number_of_OT blocks
+template <unsigned Bits>
+bool obli_filter(int number_of_OT, int n, const MatrixView<const Block<Bits>>& vec, const uint64_t* share2, Block<Bits>* result) {
+  OT_TRACE_SCOPE(kTraceFilter, uint64_t(number_of_OT) * sizeof(Block<Bits>));
+  if (!check_shares(n, share2, number_of_OT)) {
+    return false;
+  }
+  ThreadPool::global().parallel_for(0, number_of_OT, 1024, [&](size_t lo, size_t hi) {
+    for (size_t i = lo; i < hi; i++) {
+      result[i] = vec[i][tbcs_select(0, share2[i])];
+    }
+  });
+  return true;
+}
+
+template <unsigned Bits>
+BlockVector<Bits> obli_filter(int number_of_OT, int n, const BlockMatrix<Bits>& vec, const vector<uint64_t>& share2) {
+  BlockVector<Bits> result(number_of_OT);
+  if (!obli_filter(number_of_OT, n, vec.view(), share2.data(), result.data())) {
+    return BlockVector<Bits>();
+  }
+  return result;
+}
+
+// Pipelined filter: consumes the chunks of gen_res_stream as they arrive and keeps, per
+// invocation, only the one block TBCS moved to position 0; every other chunk is released
+// unread. Returns an empty vector if the stream ends early.
+template <unsigned Bits>
+BlockVector<Bits> obli_filter_stream(int number_of_OT, int n, SpscRing<Block<Bits>>& ring, const vector<uint64_t>& share2) {
+  OT_TRACE_SCOPE(kTraceFilter, uint64_t(number_of_OT) * sizeof(Block<Bits>));
+  BlockVector<Bits> result(number_of_OT);
+  bool valid = check_shares(n, share2);
+  size_t chunks = 0;
+  RingChunk tag;
+  while (const Block<Bits>* chunk = ring.front(tag)) {
+    // Drain the whole stream even when the shares are invalid, so the sender never blocks
+    if (valid && tag.row < size_t(number_of_OT)) {
+      size_t pos = tbcs_select(0, share2[tag.row]);
+      if (pos - tag.begin < tag.len) {
+        result[tag.row] = chunk[pos - tag.begin];
+      }
+    }
+    ring.pop();
+    ++chunks;
+  }
+  const size_t chunk_len = min(ring.slot_len(), size_t(n));
+  if (!valid) {
+    return BlockVector<Bits>();
+  }
+  if (chunks != size_t(number_of_OT) * ((n + chunk_len - 1) / chunk_len)) {
+    cerr << "\n Error: the response stream ended early." << endl;
+    return BlockVector<Bits>();
+  }
+  return result;
+}
+
+//--------- Phase 5: Retreive
+inline mpz_class retrive(const mpz_class& enc_m, mpz_class r) {
+  // decrypt enc_m
+  mpz_class result = enc_m ^ r;
+  return result;
+}
+
+template <unsigned Bits>
+Block<Bits> retrive(const Block<Bits>& enc_m, const Block<Bits>& r) {
+  return enc_m ^ r;
+}
+
+// Batch retrieval for all invocations: res_m[j] = enc_m[j] ^ r[j][indices[j]]
+inline void retrive(const vector<mpz_class>& enc_m, const vector<vector<mpz_class>>& r, const vector<int>& indices, vector<mpz_class>& res_m) {
+  OT_TRACE_SCOPE(kTraceRetrieve, 0);
+  ThreadPool::global().parallel_for(0, enc_m.size(), 1024, [&](size_t lo, size_t hi) {
+    for (size_t j = lo; j < hi; j++) {
+      res_m[j] = retrive(enc_m[j], r[j][indices[j]]);
+    }
+  });
+}
+
+// Gathers each invocation's pad into res_m, then unmasks the batch with one vector XOR. Pads
+// are stored (a BlockMatrix or a view of one) or seed-compressed, in which case each pad is
+// regenerated from the seed in O(1).
+template <unsigned Bits, typename Pads>
+void retrive(const Block<Bits>* enc_m, const Pads& r, const int* indices, Block<Bits>* res_m, size_t count) {
+  OT_TRACE_SCOPE(kTraceRetrieve, count * sizeof(Block<Bits>));
+  ThreadPool::global().parallel_for(0, count, 1024, [&](size_t lo, size_t hi) {
+    for (size_t j = lo; j < hi; j++) {
+      res_m[j] = r[j][indices[j]];
+    }
+    xor_blocks(res_m + lo, enc_m + lo, res_m + lo, hi - lo);
+  });
+}
+
+template <unsigned Bits, typename Pads>
+void retrive(const BlockVector<Bits>& enc_m, const Pads& r, const vector<int>& indices, BlockVector<Bits>& res_m) {
+  retrive(enc_m.data(), r, indices.data(), res_m.data(), enc_m.size());
+}
+
+//check if an integer is a power of two
+inline void checkPowerOfTwo(int n) {
+  if (n <= 0 || (n & (n - 1)) != 0) {
+    throw invalid_argument("\n\n ** Eror: The value *n* must be a power of two.**");
+  }
+}
+
+// Offline material of one batch, made ahead of demand in an OfflinePool
+// (common/offline_pool.h): the pads and, for the receiver, the random share words share2.
+// Neither depends on the indices or on m.
+template <typename Messages>
+struct Precomputed {
+  typename Messages::pad_type r;
+  vector<uint64_t> share2;
+};
+
+// Fills item `sequence` of a pool with master seed master: the pads from
+// offline_seed(master, sequence, 0) and, when with_shares (the receiver's pool), the share
+// words from offline_seed(master, sequence, 1). A sender's pool and a receiver's pool with
+// the same master therefore hold the same pads item by item.
+template <typename Messages>
+void precompute(int n, int number_of_OT, unsigned int bit_size, const PrgSeed& master, uint64_t sequence, bool with_shares, Precomputed<Messages>& item) {
+  setup(number_of_OT, n, bit_size, item.r, offline_seed(master, sequence, 0));
+  item.share2.clear();
+  if (with_shares) {
+    item.share2.resize(number_of_OT);
+    OT_TRACE_SCOPE(kTraceGenQuery, uint64_t(number_of_OT) * sizeof(uint64_t));
+    share_words(number_of_OT, tbcs_depth(n), item.share2.data(), offline_seed(master, sequence, 1));
+  }
+}
+
+// Two-party API. Each object holds one party's state for a batch of number_of_OT OTs over n
+// messages of bit_size bits; Messages is BlockMessages<Bits>, LazyBlockMessages<Bits> or
+// MpzMessages. Both parties expand the same pads from pad_seed, so setup() runs on each side
+// and nothing but the query share and the response crosses between them.
+template <typename Messages>
+class Sender {
+public:
+  typedef typename Messages::vector_type vector_type;
+  typedef typename Messages::matrix_type matrix_type;
+  typedef typename Messages::pad_type pad_type;
+
+  Sender(int n, int number_of_OT, unsigned int bit_size, const PrgSeed& pad_seed)
+      : n_(n), number_of_OT_(number_of_OT), bit_size_(bit_size), pad_seed_(pad_seed) {
+    checkPowerOfTwo(n);
+  }
+
+  // Phase 1
+  void setup() { helix::setup(number_of_OT_, n_, bit_size_, r_, pad_seed_); }
+
+  // Phase 1, offline: takes the pads of a pool item made by precompute(); item gets the
+  // previous pads back for the pool to refill
+  void setup(Precomputed<Messages>& item) { swap(r_, item.r); }
+
+  // Phase 3: the response to the receiver's share1, from messages in memory or a mapped database
+  matrix_type respond(const vector_type& m, const vector<uint64_t>& share1) const {
+    return gen_res_(number_of_OT_, n_, m, r_, share1);
+  }
+
+  template <unsigned Bits>
+  matrix_type respond(const MappedDatabase<Bits>& m, const vector<uint64_t>& share1) const {
+    return gen_res_(number_of_OT_, n_, m, r_, share1);
+  }
+
+  // Phase 3, pipelined: streams the response into ring chunk by chunk on the calling thread,
+  // for a Receiver::filter_stream running on another (see run_pipeline)
+  template <unsigned Bits>
+  bool respond_stream(const BlockVector<Bits>& m, const vector<uint64_t>& share1, SpscRing<Block<Bits>>& ring) const {
+    return gen_res_stream(m.data(), number_of_OT_, n_, r_, share1, ring);
+  }
+
+  template <unsigned Bits>
+  bool respond_stream(const MappedDatabase<Bits>& m, const vector<uint64_t>& share1, SpscRing<Block<Bits>>& ring) const {
+    return gen_res_stream(m.data(), number_of_OT_, n_, r_, share1, ring);
+  }
+
+  int n() const { return n_; }
+  int number_of_OT() const { return number_of_OT_; }
+  const pad_type& pads() const { return r_; }
+
+private:
+  int n_;
+  int number_of_OT_;
+  unsigned int bit_size_;
+  PrgSeed pad_seed_;
+  pad_type r_;
+};
+
+// Amortized multi-query sender: queues the batches of many receivers, each with its own
+// Sender (and so its own pads), and answers all of them with one shared scan over m instead
+// of one scan per receiver. Block messages only.
+template <typename Messages>
+class BatchSender {
+public:
+  typedef typename Messages::matrix_type matrix_type;
+  typedef typename Messages::pad_type pad_type;
+
+  explicit BatchSender(int n) : n_(n) {}
+
+  // Queues one receiver's share1 against sender, which must be set up. Both are referenced,
+  // not copied, until respond(); returns false if sender serves a different n or share1 is
+  // short.
+  bool add(const Sender<Messages>& sender, const vector<uint64_t>& share1) {
+    if (sender.n() != n_) {
+      cerr << "\n Error: every queued Sender must serve the same n." << endl;
+      return false;
+    }
+    if (share1.size() < size_t(sender.number_of_OT())) {
+      cerr << "\n Error: share1 must hold one word per invocation." << endl;
+      return false;
+    }
+    PendingQuery<pad_type> query = {&sender.pads(), sender.number_of_OT(), share1.data()};
+    queries_.push_back(query);
+    return true;
+  }
+
+  size_t size() const { return queries_.size(); }
+  void clear() { queries_.clear(); }
+
+  // Phase 3 for every queued query: responses in add() order
+  template <unsigned Bits>
+  vector<matrix_type> respond(const BlockVector<Bits>& m) const {
+    return gen_res_scan(m.data(), n_, queries_);
+  }
+
+  template <unsigned Bits>
+  vector<matrix_type> respond(const MappedDatabase<Bits>& m) const {
+    return gen_res_scan(m.data(), n_, queries_);
+  }
+
+private:
+  int n_;
+  vector<PendingQuery<pad_type>> queries_;
+};
+
+template <typename Messages>
+class Receiver {
+public:
+  typedef typename Messages::vector_type vector_type;
+  typedef typename Messages::matrix_type matrix_type;
+  typedef typename Messages::pad_type pad_type;
+
+  Receiver(int n, int number_of_OT, unsigned int bit_size, const PrgSeed& pad_seed)
+      : n_(n), number_of_OT_(number_of_OT), bit_size_(bit_size), pad_seed_(pad_seed), precomputed_shares_(false) {
+    checkPowerOfTwo(n);
+  }
+
+  // Phase 1
+  void setup() { helix::setup(number_of_OT_, n_, bit_size_, r_, pad_seed_); }
+
+  // Phase 1, offline: takes the pads and share words of a pool item made by precompute() with
+  // with_shares, so that the next query() only XORs in the indices
+  void setup(Precomputed<Messages>& item) {
+    swap(r_, item.r);
+    swap(share2_, item.share2);
+    precomputed_shares_ = share2_.size() == size_t(number_of_OT_);
+  }
+
+  // Phase 2: asks for message indices[j] in invocation j. Returns share1 for the sender and
+  // keeps share2 for filtering the response. After setup(item) the share words come from the
+  // item and seed is unused.
+  vector<uint64_t> query(const vector<int>& indices, const PrgSeed& seed = random_prg_seed()) {
+    indices_ = indices;
+    if (precomputed_shares_ && indices.size() >= size_t(number_of_OT_)) {
+      precomputed_shares_ = false;
+      OT_TRACE_SCOPE(kTraceGenQuery, uint64_t(number_of_OT_) * sizeof(uint64_t));
+      vector<uint64_t> share1(number_of_OT_);
+      derandomize_shares(number_of_OT_, indices.data(), share2_.data(), share1.data());
+      return share1;
+    }
+    return gen_query(n_, number_of_OT_, indices, tbcs_depth(n_), share2_, seed);
+  }
+
+  // Phase 4: one masked message per invocation out of the sender's response
+  vector_type filter(const matrix_type& response) const {
+    return obli_filter(number_of_OT_, n_, response, share2_);
+  }
+
+  // Phase 4, pipelined: filters the chunks of Sender::respond_stream as they arrive
+  template <unsigned Bits>
+  vector_type filter_stream(SpscRing<Block<Bits>>& ring) const {
+    return obli_filter_stream(number_of_OT_, n_, ring, share2_);
+  }
+
+  // Phase 5: out[j] = m[indices[j]]
+  void retrieve(const vector_type& filtered, vector_type& out) const {
+    if (out.size() != size_t(number_of_OT_)) {
+      out = vector_type(number_of_OT_);
+    }
+    retrive(filtered, r_, indices_, out);
+  }
+
+  int n() const { return n_; }
+  int number_of_OT() const { return number_of_OT_; }
+
+private:
+  int n_;
+  int number_of_OT_;
+  unsigned int bit_size_;
+  PrgSeed pad_seed_;
+  pad_type r_;
+  vector<int> indices_;
+  vector<uint64_t> share2_;
+  bool precomputed_shares_;
+};
+
+// Reusable working memory for a stream of batches of one configuration, with both parties in
+// one process. The buffers of every phase (pads, both shares, the response, the filtered and
+// the retrieved messages) are regions of one Arena sized once from (n, number_of_OT), so after
+// construction a batch performs no heap allocation. Each phase writes into its region and
+// returns a view of it, valid until the next begin(). Block messages only: Messages is
+// BlockMessages<Bits> or LazyBlockMessages<Bits>.
+template <typename Messages>
+class Context {
+public:
+  typedef typename Messages::value_type value_type;
+  typedef typename Messages::vector_type vector_type;
+  typedef ArenaPads<typename Messages::pad_type> arena_pads;
+  typedef typename arena_pads::type pad_type;
+
+  Context(int n, int number_of_OT, unsigned int bit_size)
+      : n_(n), number_of_OT_(number_of_OT), bit_size_(bit_size), share1_(nullptr), share2_(nullptr), filtered_(nullptr), out_(nullptr) {
+    checkPowerOfTwo(n);
+    arena_.reserve(arena_bytes(n, number_of_OT));
+    invocations_.reserve(number_of_OT);
+    begin();
+  }
+
+  // Arena bytes of one batch
+  static size_t arena_bytes(int n, int number_of_OT) {
+    return arena_pads::bytes(number_of_OT, n) + 2 * Arena::bytes_for<uint64_t>(number_of_OT) +
+           Arena::bytes_for<value_type>(size_t(number_of_OT) * n) + 2 * Arena::bytes_for<value_type>(number_of_OT);
+  }
+
+  // Starts a batch; the views of the previous one are handed out again
+  void begin() {
+    arena_.reset();
+    r_ = arena_pads::take(arena_, number_of_OT_, n_);
+    share1_ = arena_.take<uint64_t>(number_of_OT_);
+    share2_ = arena_.take<uint64_t>(number_of_OT_);
+    response_ = arena_.take_matrix<value_type>(number_of_OT_, n_);
+    filtered_ = arena_.take<value_type>(number_of_OT_);
+    out_ = arena_.take<value_type>(number_of_OT_);
+  }
+
+  // Phase 1, for both parties
+  void setup(const PrgSeed& pad_seed) { helix::setup(number_of_OT_, n_, bit_size_, r_, pad_seed); }
+
+  // Phase 2: asks for message indices[j] in invocation j. Returns share1 for the sender (number_of_OT
+  // words) and keeps share2 for filter(); nullptr if the indices do not cover the batch.
+  const uint64_t* query(const vector<int>& indices, const PrgSeed& seed = random_prg_seed()) {
+    if (indices.size() < size_t(number_of_OT_)) {
+      cerr << "\n Error: one index per invocation is required." << endl;
+      return nullptr;
+    }
+    return gen_query(n_, number_of_OT_, indices.data(), tbcs_depth(n_), share1_, share2_, seed) ? share1_ : nullptr;
+  }
+
+  // Phase 3: the response to share1, from messages in memory or a mapped database; an empty
+  // view if share1 is invalid
+  MatrixView<const value_type> respond(const vector_type& m, const uint64_t* share1) { return respond(m.data(), share1); }
+
+  template <unsigned Bits>
+  MatrixView<const value_type> respond(const MappedDatabase<Bits>& m, const uint64_t* share1) {
+    return respond(m.data(), share1);
+  }
+
+  // Phase 4: one masked message per invocation, or nullptr if the response is empty
+  const value_type* filter(const MatrixView<const value_type>& response) {
+    if (response.rows() < size_t(number_of_OT_) || response.cols() != size_t(n_)) {
+      return nullptr;
+    }
+    return obli_filter(number_of_OT_, n_, response, share2_, filtered_) ? filtered_ : nullptr;
+  }
+
+  // Phase 5: out[j] = m[indices[j]] for the indices given to query()
+  const value_type* retrieve(const value_type* filtered, const vector<int>& indices) {
+    retrive(filtered, r_, indices.data(), out_, number_of_OT_);
+    return out_;
+  }
+
+  int n() const { return n_; }
+  int number_of_OT() const { return number_of_OT_; }
+  size_t arena_capacity() const { return arena_.capacity(); }
+
+private:
+  MatrixView<const value_type> respond(const value_type* m, const uint64_t* share1) {
+    PendingQuery<pad_type> query = {&r_, number_of_OT_, share1};
+    if (share1 == nullptr || !gen_res_scan(m, n_, &query, &response_, 1, invocations_)) {
+      return MatrixView<const value_type>();
+    }
+    return response_;
+  }
+
+  Context(const Context&);
+  Context& operator=(const Context&);
+
+  int n_;
+  int number_of_OT_;
+  unsigned int bit_size_;
+  Arena arena_;
+  pad_type r_;
+  uint64_t* share1_;
+  uint64_t* share2_;
+  MatrixView<value_type> response_;
+  value_type* filtered_;
+  value_type* out_;
+  vector<QueryInvocation> invocations_;
+};
+
+} // namespace helix
+
+#endif
@@ -0,0 +1,1210 @@
+#ifndef OT_PRIORITY_OT_H
+#define OT_PRIORITY_OT_H
+
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+#include <bitset>
+#include <cmath>
+#include <gmpxx.h>
+#include <chrono> // For std::chrono::system_clock
+#include <ctime>
+#include <cstdlib>
+#include <algorithm> // For std::shuffle
+#include <random>
+#include <utility>   // For std::pair
+#include <atomic>
+#include <iterator>
+#include <memory>
+#include "../common/block.h"
+#include "../common/xor_kernel.h"
+#include "../common/batch.h"
+#include "../common/prg.h"
+#include "../common/lazy_pads.h"
+#include "../common/database.h"
+#include "../common/permutation.h"
+#include "../common/prp.h"
+#include "../common/spsc_ring.h"
+#include "../common/arena.h"
+#include "../common/offline_pool.h"
+#include "../common/trace.h"
+
+// Priority OT (ordered t-out-of-n OT): the phase functions, and Sender/Receiver objects that
+// hold one party's state across the phases. main.cpp is a timing driver built on top of this
+// header.
+namespace priority {
+
+using namespace std;
+
+// Phase 1: Setup--- it generates a vector of random values (for each invocation)
+// Pads are expanded from a 128-bit seed by the counter-mode PRG (AES-NI, or ChaCha20 where
+// AES-NI is missing): pad r[j][i] is read from stream j at offset i, so invocations and chunks
+// of them are filled in parallel, and a fixed seed gives the same pads for any thread count
+inline void Setup(int number_of_OT, int n, unsigned int bit_size, vector<vector<mpz_class>>& random_numbers_collection, const PrgSeed& seed = random_prg_seed()) {
+  OT_TRACE_SCOPE(kTraceSetup, uint64_t(number_of_OT) * n * ((bit_size + 7) / 8));
+  // Declare the outer vector to hold 'number_of_OT' vectors of random numbers
+  random_numbers_collection.assign(number_of_OT, vector<mpz_class>(n));
+  const Prg prg(seed);
+  const size_t words = (bit_size + 63) / 64;
+  batch_for(ThreadPool::global(), number_of_OT, n, [&](size_t j, size_t lo, size_t hi) {
+    const size_t batch = 256; // numbers expanded per PRG call
+    vector<uint64_t> buf(batch * words);
+    vector<mpz_class>& v = random_numbers_collection[j];
+    for (size_t begin = lo; begin < hi; begin += batch) {
+      size_t len = min(batch, hi - begin);
+      prg.fill(j, begin * words, buf.data(), len * words);
+      for (size_t i = 0; i < len; ++i) {
+        // Import the words and keep the low bit_size bits
+        mpz_import(v[begin + i].get_mpz_t(), words, -1, sizeof(uint64_t), 0, 0, &buf[i * words]);
+        mpz_fdiv_r_2exp(v[begin + i].get_mpz_t(), v[begin + i].get_mpz_t(), bit_size);
+      }
+    }
+  });
+}
+
+// Fixed-width Setup: all number_of_OT x n pads live in one flat buffer, which the PRG writes
+// directly in large runs
+template <unsigned Bits>
+void Setup(int number_of_OT, int n, unsigned int bit_size, const MatrixView<Block<Bits>>& random_numbers_collection, const PrgSeed& seed = random_prg_seed()) {
+  OT_TRACE_SCOPE(kTraceSetup, uint64_t(number_of_OT) * n * sizeof(Block<Bits>));
+  const Prg prg(seed);
+  batch_for(ThreadPool::global(), number_of_OT, n, [&](size_t j, size_t lo, size_t hi) {
+    prg.fill_blocks(j, lo, random_numbers_collection[j] + lo, hi - lo);
+  });
+}
+
+template <unsigned Bits>
+void Setup(int number_of_OT, int n, unsigned int bit_size, BlockMatrix<Bits>& random_numbers_collection, const PrgSeed& seed = random_prg_seed()) {
+  random_numbers_collection.resize(number_of_OT, n);
+  Setup(number_of_OT, n, bit_size, random_numbers_collection.view(), seed);
+}
+
+// Seed-compressed Setup: only the seed is kept; pads are regenerated where they are used
+template <unsigned Bits>
+void Setup(int number_of_OT, int n, unsigned int bit_size, LazyPads<Bits>& random_numbers_collection, const PrgSeed& seed = random_prg_seed()) {
+  OT_TRACE_SCOPE(kTraceSetup, 0);
+  random_numbers_collection = LazyPads<Bits>(number_of_OT, n, seed);
+}
+
+
+// // Fisher-Yates shuffle for random permutation
+// template<typename T>
+// void FisherYatesShuffle(vector<T>& vec) {
+//
+//     random_device rd;
+//     mt19937 g(rd());
+//
+//     for (int i = vec.size() - 1; i > 0; --i) {
+//         uniform_int_distribution<> dis(0, i);
+//         int j = dis(g);
+//         swap(vec[i], vec[j]);
+//     }
+// }
+
+// Phase 2: genQuery---Query Generation-- It generates the query permutations w[i] and the positions y[i] (for each invocation)
+// w keeps each shuffled permutation with its dense inverse, built in one linear pass; the
+// sender scatters by the inverse and y[i][j] is a direct read of it. y is a vector of rows or a
+// view, already holding p_size entries per invocation.
+//
+// The shuffle does not depend on p, so it can also run offline (shuffle_permutations) and
+// leave only fill_positions for the online path.
+inline void shuffle_permutation(int n, PermutationSet& result, size_t i, mt19937& rng, unsigned long seed) {
+  // Generate w[i] with elements from 0 to n-1
+  int* v = result.forward(i);
+  for (int k = 0; k < n; ++k) {
+    v[k] = k;
+  }
+  seed_stream(rng, seed, i);
+  // Shuffle w[i] in-place
+  shuffle(v, v + n, rng);
+  result.invert(i);
+}
+
+// y[i][j] is the position of p[i][j] in w[i]
+template <typename Positions>
+void fill_positions(int p_size, const vector<vector<int>>& p, const PermutationSet& result, size_t i, Positions& y) {
+  const int* inv = result.inverse(i);
+  for (int j = 0; j < p_size; ++j) {
+    y[i][j] = inv[p[i][j]];
+  }
+}
+
+template <typename Positions>
+void fill_query(int number_of_OT, int p_size, const vector<vector<int>>& p, int n, PermutationSet& result, Positions& y, unsigned long seed) {
+  OT_TRACE_SCOPE(kTraceGenQuery, uint64_t(number_of_OT) * n * sizeof(int));
+  ThreadPool::global().parallel_for(0, number_of_OT, 1, [&](size_t lo, size_t hi) {
+    // One random stream per invocation
+    mt19937 rng;
+    for (size_t i = lo; i < hi; ++i) {
+      shuffle_permutation(n, result, i, rng, seed);
+      fill_positions(p_size, p, result, i, y);
+    }
+  });
+}
+
+// Offline half of genQuery: w resized to number_of_OT x n and shuffled as genQuery(..., seed) would
+inline void shuffle_permutations(int number_of_OT, int n, PermutationSet& w, unsigned long seed) {
+  OT_TRACE_SCOPE(kTraceGenQuery, uint64_t(number_of_OT) * n * sizeof(int));
+  w.resize(number_of_OT, n);
+  ThreadPool::global().parallel_for(0, number_of_OT, 1, [&](size_t lo, size_t hi) {
+    mt19937 rng;
+    for (size_t i = lo; i < hi; ++i) {
+      shuffle_permutation(n, w, i, rng, seed);
+    }
+  });
+}
+
+// Online half: the positions y (number_of_OT rows of p_size) of p under the shuffled w
+template <typename Positions>
+void fill_positions(int number_of_OT, int p_size, const vector<vector<int>>& p, const PermutationSet& w, Positions& y) {
+  OT_TRACE_SCOPE(kTraceGenQuery, uint64_t(number_of_OT) * p_size * sizeof(int));
+  ThreadPool::global().parallel_for(0, number_of_OT, 64, [&](size_t lo, size_t hi) {
+    for (size_t i = lo; i < hi; ++i) {
+      fill_positions(p_size, p, w, i, y);
+    }
+  });
+}
+
+inline PermutationSet genQuery(int number_of_OT, int p_size, const vector<vector<int>>& p, int n, vector<vector<int>>& y, unsigned long seed = random_device()()) {
+  // Pre-allocate memory for the permutations and y vectors
+  PermutationSet result(number_of_OT, n);
+  y.resize(number_of_OT);
+  for (int i = 0; i < number_of_OT; ++i) {
+    y[i].resize(p_size);
+  }
+  fill_query(number_of_OT, p_size, p, n, result, y, seed);
+  return result;
+}
+
+// Into caller-provided storage: w is resized to number_of_OT x n (which keeps its buffers when
+// it already has that shape) and y holds number_of_OT x p_size
+inline void genQuery(int number_of_OT, int p_size, const vector<vector<int>>& p, int n, PermutationSet& w, MatrixView<int> y, unsigned long seed) {
+  w.resize(number_of_OT, n);
+  fill_query(number_of_OT, p_size, p, n, w, y, seed);
+}
+
+// PRP query mode: w is a key for one FeistelPrp per invocation instead of n ints, and pi_i is
+// never materialized. Message p[i][j] is at position pi_i(p[i][j]), so the receiver does t
+// PRP evaluations per invocation in place of the O(n) shuffle and inverse.
+template <typename Positions>
+void fill_query_prp(int number_of_OT, int p_size, const vector<vector<int>>& p, const FeistelPrp& prp, Positions& y) {
+  OT_TRACE_SCOPE(kTraceGenQuery, uint64_t(number_of_OT) * p_size * sizeof(int));
+  ThreadPool::global().parallel_for(0, number_of_OT, 64, [&](size_t lo, size_t hi) {
+    for (size_t i = lo; i < hi; ++i) {
+      for (int j = 0; j < p_size; ++j) {
+        y[i][j] = int(prp.permute(i, p[i][j]));
+      }
+    }
+  });
+}
+
+inline FeistelPrp genQueryPrp(int number_of_OT, int p_size, const vector<vector<int>>& p, int n, vector<vector<int>>& y, const PrgSeed& seed = random_prg_seed()) {
+  FeistelPrp result(seed, n);
+  y.resize(number_of_OT);
+  for (int i = 0; i < number_of_OT; ++i) {
+    y[i].resize(p_size);
+  }
+  fill_query_prp(number_of_OT, p_size, p, result, y);
+  return result;
+}
+
+// Into a caller-provided y of number_of_OT x p_size
+inline FeistelPrp genQueryPrp(int number_of_OT, int p_size, const vector<vector<int>>& p, int n, MatrixView<int> y, const PrgSeed& seed) {
+  FeistelPrp result(seed, n);
+  fill_query_prp(number_of_OT, p_size, p, result, y);
+  return result;
+}
+
+// Phase 3: GenRes---Generates a response to the receiver's query (for each invocation)
+// The query w is a PermutationSet, or a PRP key that the sender expands into PrpPositions;
+// both give the position of message i as w.positions(j, i, ...), and x[position] = m[i] ^ r[i]
+const size_t kGenResStage = 1024; // messages per positions() call and per batch XOR, small enough to stay in L1/L2
+
+// Sender-side checks before scattering: the query must cover number_of_OT invocations of
+// m_size messages, and a materialized query must only name positions inside [0, m_size).
+// seen holds one check_inverse bitmap per invocation, number_of_OT x inverse_check_words(m_size).
+inline bool check_query(const PermutationSet& w, int number_of_OT, size_t m_size, const MatrixView<uint64_t>& seen) {
+  atomic<bool> failed(w.count() < size_t(number_of_OT) || w.n() != m_size);
+  ThreadPool::global().parallel_for(0, number_of_OT, 1, [&](size_t lo, size_t hi) {
+    for (size_t j = lo; j < hi && !failed; ++j) {
+      if (!check_inverse(w.inverse(j), m_size, seen[j])) {
+        failed = true;
+      }
+    }
+  });
+  return !failed;
+}
+
+inline bool check_query(const PermutationSet& w, int number_of_OT, size_t m_size) {
+  FlatMatrix<uint64_t> seen(max(number_of_OT, 0), inverse_check_words(m_size));
+  return check_query(w, number_of_OT, m_size, seen.view());
+}
+
+// A PRP is a permutation of [0, n) by construction
+inline bool check_query(const PrpPositions& w, int number_of_OT, size_t m_size) {
+  return w.count() >= size_t(number_of_OT) && w.n() == m_size;
+}
+
+template <typename Query>
+vector<vector<mpz_class>> GenRes(const vector<mpz_class>& m, int number_of_OT, const vector<vector<mpz_class>>& r, const Query& w) {
+  OT_TRACE_SCOPE(kTraceGenRes, 0);
+  size_t m_size = m.size();  // Store m.size() in a variable to avoid recomputing
+  if (!check_query(w, number_of_OT, m_size)) {
+    cerr << "\n ** Error: invalid index during computing GenRes" << endl;
+    return {}; // Return an empty vector to indicate an error
+  }
+  vector<vector<mpz_class>> x(number_of_OT, vector<mpz_class>(m_size));
+  // Process each OT separately, invocations spread across threads
+  ThreadPool::global().parallel_for(0, number_of_OT, 1, [&](size_t lo, size_t hi) {
+    int scratch[kGenResStage];
+    for (size_t j = lo; j < hi; ++j) {
+      for (size_t base = 0; base < m_size; base += kGenResStage) {
+        size_t len = min(kGenResStage, m_size - base);
+        const int* pos = w.positions(j, base, len, scratch);
+        for (size_t i = 0; i < len; ++i) {
+          // XOR straight into the position of m[i] in the query permutation
+          x[j][pos[i]] = m[base + i] ^ r[j][base + i];
+        }
+      }
+    }
+  });
+  return x;
+}
+
+inline vector<vector<mpz_class>> GenRes(const vector<mpz_class>& m, int number_of_OT, const vector<vector<mpz_class>>& r, const FeistelPrp& w) {
+  return GenRes(m, number_of_OT, r, PrpPositions(w, number_of_OT));
+}
+
+// masked[i] = m[i] ^ r[j][begin + i] for len messages, from stored or seed-compressed pads
+template <unsigned Bits>
+void mask_chunk(Block<Bits>* masked, const Block<Bits>* m, const BlockMatrix<Bits>& r, size_t j, size_t begin, size_t len) {
+  xor_blocks(masked, m, r[j] + begin, len);
+}
+
+template <unsigned Bits>
+void mask_chunk(Block<Bits>* masked, const Block<Bits>* m, const MatrixView<Block<Bits>>& r, size_t j, size_t begin, size_t len) {
+  xor_blocks(masked, m, r[j] + begin, len);
+}
+
+template <unsigned Bits>
+void mask_chunk(Block<Bits>* masked, const Block<Bits>* m, const LazyPads<Bits>& r, size_t j, size_t begin, size_t len) {
+  r.expand(j, begin, masked, len);
+  xor_blocks(masked, m, masked, len);
+}
+
+// One receiver's batch in a multi-query GenRes: its pads and its query, in either form (the
+// PRP form already expanded into round tables). seen is optional scratch for checking perm
+// (see check_query); without it the check allocates its own.
+template <typename Pads>
+struct PendingQuery {
+  const Pads* pads;
+  int number_of_OT;
+  const PermutationSet* perm;
+  const PrpPositions* prp;
+  MatrixView<uint64_t> seen;
+
+  const int* positions(size_t j, size_t begin, size_t len, int* scratch) const {
+    return perm != nullptr ? perm->positions(j, begin, len, scratch) : prp->positions(j, begin, len, scratch);
+  }
+
+  bool check(size_t m_size) const {
+    if (perm == nullptr) {
+      return check_query(*prp, number_of_OT, m_size);
+    }
+    return seen.data() != nullptr ? check_query(*perm, number_of_OT, m_size, seen) : check_query(*perm, number_of_OT, m_size);
+  }
+};
+
+template <typename Pads>
+PendingQuery<Pads> pending_query(const Pads& r, int number_of_OT, const PermutationSet& w, const MatrixView<uint64_t>& seen = MatrixView<uint64_t>()) {
+  PendingQuery<Pads> query = {&r, number_of_OT, &w, nullptr, seen};
+  return query;
+}
+
+template <typename Pads>
+PendingQuery<Pads> pending_query(const Pads& r, int number_of_OT, const PrpPositions& w) {
+  PendingQuery<Pads> query = {&r, number_of_OT, nullptr, &w, MatrixView<uint64_t>()};
+  return query;
+}
+
+// Shared-scan GenRes over m_size messages at m: m is read once per batch in cache-sized chunks,
+// and each chunk is masked and scattered for every invocation while it is resident. The
+// invocations of every query are laid end to end and scanned together, so one pass over m
+// serves all receivers. Pads is BlockMatrix<Bits>, a view of stored pads, or LazyPads<Bits>;
+// lazy pads are expanded chunk by chunk.
+//
+// This form writes query k's response into x[k], a number_of_OT x m_size view, and keeps the
+// flat invocation list in invocations, so a caller that reuses both allocates nothing.
+// Returns false, with nothing written, if any query is invalid.
+template <unsigned Bits, typename Pads>
+bool GenResScan(const Block<Bits>* m, size_t m_size, const PendingQuery<Pads>* queries, const MatrixView<Block<Bits>>* x, size_t count, vector<QueryInvocation>& invocations) {
+  invocations.clear();
+  for (size_t k = 0; k < count; ++k) {
+    if (!queries[k].check(m_size)) {
+      cerr << "\n ** Error: invalid index during computing GenRes" << endl;
+      return false;
+    }
+    for (int j = 0; j < queries[k].number_of_OT; ++j) {
+      QueryInvocation invocation = {uint32_t(k), uint32_t(j)};
+      invocations.push_back(invocation);
+    }
+  }
+  OT_TRACE_SCOPE(kTraceGenRes, invocations.size() * m_size * sizeof(Block<Bits>));
+  scan_for(ThreadPool::global(), invocations.size(), m_size, scan_chunk(m_size, sizeof(Block<Bits>)), [&](size_t lo, size_t hi, size_t g_lo, size_t g_hi) {
+    BlockStage<Bits, kGenResStage> stage;
+    Block<Bits>* masked = stage.data();
+    int scratch[kGenResStage];
+    OT_TRACE_LAPS(laps);
+    for (size_t g = g_lo; g < g_hi; ++g) {
+      const PendingQuery<Pads>& query = queries[invocations[g].query];
+      const size_t j = invocations[g].j;
+      Block<Bits>* out = x[invocations[g].query][j];
+      for (size_t base = lo; base < hi; base += kGenResStage) {
+        size_t len = min(kGenResStage, hi - base);
+        mask_chunk(masked, m + base, *query.pads, j, base, len);
+        OT_TRACE_LAP(laps, kTraceMask, len * sizeof(Block<Bits>));
+        const int* pos = query.positions(j, base, len, scratch);
+        // Direct scatter: x[pos[i]] = m[i] ^ r[i]
+        for (size_t i = 0; i < len; ++i) {
+          out[pos[i]] = masked[i];
+        }
+        OT_TRACE_LAP(laps, kTraceScatter, len * sizeof(Block<Bits>));
+      }
+    }
+  });
+  return true;
+}
+
+// Responses in query order, or empty if any query is invalid
+template <unsigned Bits, typename Pads>
+vector<BlockMatrix<Bits>> GenResScan(const Block<Bits>* m, size_t m_size, const vector<PendingQuery<Pads>>& queries) {
+  vector<BlockMatrix<Bits>> x(queries.size());
+  vector<MatrixView<Block<Bits>>> out(queries.size());
+  for (size_t k = 0; k < queries.size(); ++k) {
+    x[k].resize(queries[k].number_of_OT, m_size);
+    out[k] = x[k].view();
+  }
+  vector<QueryInvocation> invocations;
+  if (!GenResScan(m, m_size, queries.data(), out.data(), queries.size(), invocations)) {
+    return vector<BlockMatrix<Bits>>();
+  }
+  return x;
+}
+
+template <unsigned Bits, typename Pads, typename Query>
+BlockMatrix<Bits> GenResScan(const Block<Bits>* m, size_t m_size, int number_of_OT, const Pads& r, const Query& w) {
+  vector<PendingQuery<Pads>> queries(1, pending_query(r, number_of_OT, w));
+  vector<BlockMatrix<Bits>> x = GenResScan(m, m_size, queries);
+  return x.empty() ? BlockMatrix<Bits>() : move(x[0]);
+}
+
+template <unsigned Bits, typename Pads>
+BlockMatrix<Bits> GenResScan(const Block<Bits>* m, size_t m_size, int number_of_OT, const Pads& r, const FeistelPrp& w) {
+  return GenResScan(m, m_size, number_of_OT, r, PrpPositions(w, number_of_OT));
+}
+
+template <unsigned Bits, typename Pads, typename Query>
+BlockMatrix<Bits> GenRes(const BlockVector<Bits>& m, int number_of_OT, const Pads& r, const Query& w) {
+  return GenResScan(m.data(), m.size(), number_of_OT, r, w);
+}
+
+// Streams a memory-mapped database; records go from the mapped pages straight into the XOR
+template <unsigned Bits, typename Pads, typename Query>
+BlockMatrix<Bits> GenRes(const MappedDatabase<Bits>& m, int number_of_OT, const Pads& r, const Query& w) {
+  return GenResScan(m.data(), m.size(), number_of_OT, r, w);
+}
+
+// out[k] = m[src[k]] ^ r[j][src[k]] for len gathered sources
+template <unsigned Bits>
+void gather_masked(Block<Bits>* out, const Block<Bits>* m, const BlockMatrix<Bits>& r, size_t j, const int* src, size_t len) {
+  const Block<Bits>* pad = r[j];
+  for (size_t k = 0; k < len; ++k) {
+    out[k] = m[src[k]] ^ pad[src[k]];
+  }
+}
+
+template <unsigned Bits>
+void gather_masked(Block<Bits>* out, const Block<Bits>* m, const LazyPads<Bits>& r, size_t j, const int* src, size_t len) {
+  for (size_t k = 0; k < len; ++k) {
+    out[k] = m[src[k]] ^ r.at(j, src[k]);
+  }
+}
+
+// GenResStream gathers through the forward rows, so on top of check_query each forward row
+// must invert its inverse row. A query deserialized from the wire carries no forward rows and
+// is refused.
+inline bool check_stream_query(const PermutationSet& w, int number_of_OT, size_t m_size) {
+  if (!check_query(w, number_of_OT, m_size)) {
+    return false;
+  }
+  atomic<bool> failed(false);
+  ThreadPool::global().parallel_for(0, number_of_OT, 1, [&](size_t lo, size_t hi) {
+    for (size_t j = lo; j < hi && !failed; ++j) {
+      if (!check_forward(w.forward(j), w.inverse(j), m_size)) {
+        failed = true;
+      }
+    }
+  });
+  return !failed;
+}
+
+inline bool check_stream_query(const PrpPositions& w, int number_of_OT, size_t m_size) {
+  return check_query(w, number_of_OT, m_size);
+}
+
+// Streaming GenRes for the pipelined mode: each invocation's response is produced in ring-slot
+// sized chunks of output positions on the calling thread and handed to the receiver's
+// oblFilterStream through ring, so no more than the ring's slots are ever held. A chunk is
+// gathered rather than scattered: position k holds m[i] ^ r[i] for the message i that w
+// places there (w.sources). Closes the ring when done; returns false, with the ring closed
+// and empty, if the query is invalid.
+template <unsigned Bits, typename Pads, typename Query>
+bool GenResStream(const Block<Bits>* m, size_t m_size, int number_of_OT, const Pads& r, const Query& w, SpscRing<Block<Bits>>& ring) {
+  OT_TRACE_SCOPE(kTraceGenRes, uint64_t(number_of_OT) * m_size * sizeof(Block<Bits>));
+  if (!check_stream_query(w, number_of_OT, m_size)) {
+    cerr << "\n ** Error: invalid index during computing GenRes" << endl;
+    ring.close();
+    return false;
+  }
+  const size_t chunk = min(ring.slot_len(), m_size);
+  vector<int> scratch(chunk);
+  for (size_t j = 0; j < size_t(number_of_OT); ++j) {
+    for (size_t lo = 0; lo < m_size; lo += chunk) {
+      size_t len = min(chunk, m_size - lo);
+      Block<Bits>* slot = ring.acquire();
+      OT_TRACE_SCOPE(kTraceScatter, len * sizeof(Block<Bits>));
+      gather_masked(slot, m, r, j, w.sources(j, lo, len, scratch.data()), len);
+      RingChunk tag = {j, lo, len};
+      ring.publish(tag);
+    }
+  }
+  ring.close();
+  return true;
+}
+
+template <unsigned Bits, typename Pads>
+bool GenResStream(const Block<Bits>* m, size_t m_size, int number_of_OT, const Pads& r, const FeistelPrp& w, SpscRing<Block<Bits>>& ring) {
+  return GenResStream(m, m_size, number_of_OT, r, PrpPositions(w, number_of_OT), ring);
+}
+
+// mpz_class path over a mapped database: records are imported as they are read
+template <unsigned Bits, typename Query>
+vector<vector<mpz_class>> GenRes(const MappedDatabase<Bits>& m, int number_of_OT, const vector<vector<mpz_class>>& r, const Query& w) {
+  OT_TRACE_SCOPE(kTraceGenRes, uint64_t(number_of_OT) * m.size() * sizeof(Block<Bits>));
+  if (!check_query(w, number_of_OT, m.size())) {
+    cerr << "\n ** Error: invalid index during computing GenRes" << endl;
+    return {};
+  }
+  vector<vector<mpz_class>> x(number_of_OT, vector<mpz_class>(m.size()));
+  ThreadPool::global().parallel_for(0, number_of_OT, 1, [&](size_t lo, size_t hi) {
+    int scratch[kGenResStage];
+    for (size_t j = lo; j < hi; ++j) {
+      for (size_t base = 0; base < m.size(); base += kGenResStage) {
+        size_t len = min(kGenResStage, m.size() - base);
+        const int* pos = w.positions(j, base, len, scratch);
+        for (size_t i = 0; i < len; ++i) {
+          x[j][pos[i]] = m[base + i].to_mpz() ^ r[j][base + i];
+        }
+      }
+    }
+  });
+  return x;
+}
+
+template <unsigned Bits>
+vector<vector<mpz_class>> GenRes(const MappedDatabase<Bits>& m, int number_of_OT, const vector<vector<mpz_class>>& r, const FeistelPrp& w) {
+  return GenRes(m, number_of_OT, r, PrpPositions(w, number_of_OT));
+}
+
+// Phase 4: oblFilter---Oblivious filtering--returns a single message (for each invocation)
+inline vector<vector<mpz_class>> oblFilter(int number_of_OT, int p_size, const vector<vector<mpz_class>>& res_s, const vector<vector<int>>& y) {
+  OT_TRACE_SCOPE(kTraceFilter, 0);
+  // Preallocate the outer vector with the correct size
+  vector<vector<mpz_class>> res(number_of_OT, vector<mpz_class>(p_size));
+  // Iterate over the number of OTs
+  ThreadPool::global().parallel_for(0, number_of_OT, 256, [&](size_t lo, size_t hi) {
+    for (size_t j = lo; j < hi; ++j) {
+      // Iterate over each element in the current OT
+      for (int i = 0; i < p_size; ++i) {
+        // Assign the value from res_s based on the index from y
+        res[j][i] = res_s[j][y[j][i]];
+      }
+    }
+  });
+  return res;
+}
+
+// res[j][i] = res_s[j][y[j][i]] over flat rows: matrices, views, or a vector of rows for y
+template <typename Response, typename Positions, typename Out>
+void filter_rows(int number_of_OT, int p_size, const Response& res_s, const Positions& y, Out& res) {
+  OT_TRACE_SCOPE(kTraceFilter, uint64_t(number_of_OT) * p_size * sizeof(res[0][0]));
+  ThreadPool::global().parallel_for(0, number_of_OT, 256, [&](size_t lo, size_t hi) {
+    OT_TRACE_SCOPE(kTraceGather, (hi - lo) * p_size * sizeof(res[0][0]));
+    for (size_t j = lo; j < hi; ++j) {
+      for (int i = 0; i < p_size; ++i) {
+        res[j][i] = res_s[j][y[j][i]];
+      }
+    }
+  });
+}
+
+template <unsigned Bits>
+BlockMatrix<Bits> oblFilter(int number_of_OT, int p_size, const BlockMatrix<Bits>& res_s, const vector<vector<int>>& y) {
+  BlockMatrix<Bits> res(number_of_OT, p_size);
+  filter_rows(number_of_OT, p_size, res_s, y, res);
+  return res;
+}
+
+// Into a caller-provided res of number_of_OT x p_size
+template <unsigned Bits>
+void oblFilter(int number_of_OT, int p_size, const MatrixView<const Block<Bits>>& res_s, const MatrixView<const int>& y, const MatrixView<Block<Bits>>& res) {
+  filter_rows(number_of_OT, p_size, res_s, y, res);
+}
+
+// Pipelined filter: consumes the chunks of GenResStream as they arrive. Only chunks that hold
+// one of the invocation's t positions y[j] are read, and only those t blocks are kept; the
+// rest are released unread. Returns an empty matrix if the stream ends early.
+template <unsigned Bits>
+BlockMatrix<Bits> oblFilterStream(int number_of_OT, int p_size, int n, SpscRing<Block<Bits>>& ring, const vector<vector<int>>& y) {
+  OT_TRACE_SCOPE(kTraceFilter, uint64_t(number_of_OT) * p_size * sizeof(Block<Bits>));
+  BlockMatrix<Bits> res(number_of_OT, p_size);
+  size_t chunks = 0;
+  RingChunk tag;
+  while (const Block<Bits>* chunk = ring.front(tag)) {
+    if (tag.row < size_t(number_of_OT)) {
+      const vector<int>& positions = y[tag.row];
+      for (int i = 0; i < p_size; ++i) {
+        size_t offset = size_t(positions[i]) - tag.begin;
+        if (offset < tag.len) {
+          res[tag.row][i] = chunk[offset];
+        }
+      }
+    }
+    ring.pop();
+    ++chunks;
+  }
+  const size_t chunk_len = min(ring.slot_len(), size_t(n));
+  if (chunks != size_t(number_of_OT) * ((n + chunk_len - 1) / chunk_len)) {
+    cerr << "\n ** Error: the response stream ended early" << endl;
+    return BlockMatrix<Bits>();
+  }
+  return res;
+}
+
+// Phase 4: retreive---messgae retreival (for each invocation)
+inline mpz_class retreive(const mpz_class& res_h, int j, const vector<mpz_class>& r, const vector<int>& p) {
+  // Check if j is within the valid range
+  if (j >= p.size()) {
+    cerr << "\n *** Error: priority must be smaller than the size of priority vector p" << endl;
+    return {};
+  }
+  // Return the result of the XOR operation directly
+  return res_h ^ r[p[j]];
+}
+
+// r points at the invocation's row of the flat pad buffer
+template <unsigned Bits>
+Block<Bits> retreive(const Block<Bits>& res_h, int j, const Block<Bits>* r, const vector<int>& p) {
+  if (j >= p.size()) {
+    cerr << "\n *** Error: priority must be smaller than the size of priority vector p" << endl;
+    return Block<Bits>();
+  }
+  return res_h ^ r[p[j]];
+}
+
+// Seed-compressed pads: regenerates r[p[j]] in O(1)
+template <unsigned Bits>
+Block<Bits> retreive(const Block<Bits>& res_h, int j, const LazyPadRow<Bits>& r, const vector<int>& p) {
+  if (j >= p.size()) {
+    cerr << "\n *** Error: priority must be smaller than the size of priority vector p" << endl;
+    return Block<Bits>();
+  }
+  return res_h ^ r[p[j]];
+}
+
+// Row k of a response, a set of pads, positions or an output, whatever its storage: a pointer
+// for flat and nested rows, a LazyPadRow for seed-compressed pads
+template <typename T>
+const T* row_of(const vector<vector<T>>& rows, size_t k) { return rows[k].data(); }
+
+template <typename T>
+T* row_of(vector<vector<T>>& rows, size_t k) { return rows[k].data(); }
+
+template <typename T>
+const T* row_of(const FlatMatrix<T>& rows, size_t k) { return rows[k]; }
+
+template <typename T>
+T* row_of(FlatMatrix<T>& rows, size_t k) { return rows[k]; }
+
+template <typename T>
+T* row_of(const MatrixView<T>& rows, size_t k) { return rows[k]; }
+
+template <unsigned Bits>
+LazyPadRow<Bits> row_of(const LazyPads<Bits>& rows, size_t k) { return rows[k]; }
+
+// Lazy ordered retrieval of one invocation, straight from the sender's response: choice j is
+// decrypted as response[y[j]] ^ r[p[j]] only when the consumer reaches it, so a consumer that
+// stops after the first usable item pays for that item alone and oblFilter never runs.
+// Iterating yields the choices in priority order, by value. Value is Block<Bits> or
+// mpz_class; PadRow is the invocation's row of pads (row_of). Every row is referenced, so the
+// response, y, the pads and p must outlive it.
+template <typename Value, typename PadRow>
+class OrderedRetrieval {
+public:
+  class iterator {
+  public:
+    typedef input_iterator_tag iterator_category;
+    typedef Value value_type;
+    typedef ptrdiff_t difference_type;
+    typedef const Value* pointer;
+    typedef Value reference;
+
+    iterator(const OrderedRetrieval* owner, int j) : owner_(owner), j_(j) {}
+
+    Value operator*() const { return (*owner_)[j_]; }
+    iterator& operator++() {
+      ++j_;
+      return *this;
+    }
+    iterator operator++(int) {
+      iterator before = *this;
+      ++j_;
+      return before;
+    }
+    // Priority of the choice the iterator is on
+    int priority() const { return j_; }
+
+    bool operator==(const iterator& o) const { return j_ == o.j_; }
+    bool operator!=(const iterator& o) const { return j_ != o.j_; }
+
+  private:
+    const OrderedRetrieval* owner_;
+    int j_;
+  };
+
+  OrderedRetrieval(const Value* response, const int* y, const PadRow& r, const int* p, int p_size)
+      : response_(response), y_(y), r_(r), p_(p), p_size_(p_size) {}
+
+  int size() const { return p_size_; }
+
+  // Choice j < size(), decrypted now
+  Value operator[](int j) const { return response_[y_[j]] ^ r_[p_[j]]; }
+
+  iterator begin() const { return iterator(this, 0); }
+  iterator end() const { return iterator(this, p_size_); }
+
+private:
+  const Value* response_;
+  const int* y_;
+  PadRow r_;
+  const int* p_;
+  int p_size_;
+};
+
+template <typename Value, typename PadRow>
+OrderedRetrieval<Value, PadRow> ordered_retrieval(const Value* response, const int* y, const PadRow& r, const int* p, int p_size) {
+  return OrderedRetrieval<Value, PadRow>(response, y, r, p, p_size);
+}
+
+// Choices unmasked per step of the batch retrieval; one step's pads sit in an uninitialized
+// stack buffer
+const size_t kRetrieveStage = 256;
+
+// out[j] = enc[pos[j]] ^ r[p[j]] for the p_size choices of one invocation, where pos == nullptr
+// means enc is already filtered (pos[j] = j). The encrypted entries and the pads are gathered
+// into contiguous buffers and unmasked with one vector XOR per step.
+template <unsigned Bits, typename PadRow>
+void decrypt_row(const Block<Bits>* enc, const int* pos, const PadRow& r, const int* p, int p_size, Block<Bits>* out) {
+  BlockStage<Bits, kRetrieveStage> stage;
+  Block<Bits>* pads = stage.data();
+  for (size_t base = 0; base < size_t(p_size); base += kRetrieveStage) {
+    size_t len = min(kRetrieveStage, size_t(p_size) - base);
+    const Block<Bits>* src = enc + base;
+    if (pos != nullptr) {
+      for (size_t j = 0; j < len; ++j) {
+        out[base + j] = enc[pos[base + j]];
+      }
+      src = out + base;
+    }
+    for (size_t j = 0; j < len; ++j) {
+      pads[j] = r[p[base + j]];
+    }
+    xor_blocks(out + base, src, pads, len);
+  }
+}
+
+template <typename PadRow>
+void decrypt_row(const mpz_class* enc, const int* pos, const PadRow& r, const int* p, int p_size, mpz_class* out) {
+  for (int j = 0; j < p_size; ++j) {
+    out[j] = enc[pos != nullptr ? pos[j] : j] ^ r[p[j]];
+  }
+}
+
+// Phases 4 and 5 for the whole batch in one pass: out[k][j] = m[p[k][j]] for every invocation k
+// and priority j, gathered from the response through y without an intermediate filtered copy.
+// out must already hold number_of_OT rows of p_size.
+template <typename Response, typename Positions, typename Pads, typename Out>
+void retreiveAll(int number_of_OT, int p_size, const Response& res_s, const Positions& y, const Pads& r, const vector<vector<int>>& p, Out& out) {
+  OT_TRACE_SCOPE(kTraceRetrieve, uint64_t(number_of_OT) * p_size * sizeof(out[0][0]));
+  ThreadPool::global().parallel_for(0, number_of_OT, 64, [&](size_t lo, size_t hi) {
+    OT_TRACE_SCOPE(kTraceGather, (hi - lo) * p_size * sizeof(out[0][0]));
+    for (size_t k = lo; k < hi; ++k) {
+      decrypt_row(row_of(res_s, k), row_of(y, k), row_of(r, k), p[k].data(), p_size, row_of(out, k));
+    }
+  });
+}
+
+// Same, from the output of oblFilter (or oblFilterStream)
+template <typename Filtered, typename Pads, typename Out>
+void retreiveAll(int number_of_OT, int p_size, const Filtered& res_h, const Pads& r, const vector<vector<int>>& p, Out& out) {
+  OT_TRACE_SCOPE(kTraceRetrieve, uint64_t(number_of_OT) * p_size * sizeof(out[0][0]));
+  ThreadPool::global().parallel_for(0, number_of_OT, 64, [&](size_t lo, size_t hi) {
+    OT_TRACE_SCOPE(kTraceGather, (hi - lo) * p_size * sizeof(out[0][0]));
+    for (size_t k = lo; k < hi; ++k) {
+      decrypt_row(row_of(res_h, k), static_cast<const int*>(nullptr), row_of(r, k), p[k].data(), p_size, row_of(out, k));
+    }
+  });
+}
+
+// Gives out number_of_OT rows of p_size
+template <unsigned Bits>
+void shape_rows(BlockMatrix<Bits>& out, int rows, int cols) {
+  out.resize(rows, cols);
+}
+
+inline void shape_rows(vector<vector<mpz_class>>& out, int rows, int cols) {
+  out.resize(rows);
+  for (int k = 0; k < rows; ++k) {
+    out[k].resize(cols);
+  }
+}
+
+// Function to generate a random big integer with a specified number of bits-- used for test
+inline mpz_class generate_random_bigint(gmp_randclass& rng, int num_bits) {
+  return rng.get_z_bits(num_bits);
+}
+
+inline void generate_random_bigint(gmp_randclass& rng, int num_bits, mpz_class& out) {
+  out = rng.get_z_bits(num_bits);
+}
+
+// Fixed-width variant: num_bits must not exceed Bits
+template <unsigned Bits>
+void generate_random_bigint(gmp_randclass& rng, int num_bits, Block<Bits>& out) {
+  out.assign(rng.get_z_bits(num_bits));
+}
+
+// generates vectors of random values
+inline vector<vector<int>> generateRandomVectors(int p_size, int number_of_OT, int n) {
+  // Vector to hold the collection of vectors
+  vector<vector<int>> random_vectors;
+  random_vectors.reserve(number_of_OT); // Reserve space for efficiency
+  // Generate 'number_of_OT' vectors
+  for (int i = 0; i < number_of_OT; ++i) {
+    // Create a vector with all possible values from 0 to n-1
+    vector<int> values(n);
+    for (int j = 0; j < n; ++j) {
+      values[j] = j;
+    }
+    // Seed the random number generator with a unique seed
+    unsigned seed = chrono::system_clock::now().time_since_epoch().count() + i;
+    shuffle(values.begin(), values.end(), mt19937(seed));
+    // Select the first 'p_size' elements to ensure they are distinct
+    vector<int> vec(values.begin(), values.begin() + p_size);
+    // Add the generated vector to the collection
+    random_vectors.push_back(move(vec));
+  }
+  return random_vectors;
+}
+
+// Offline material of one batch, made ahead of demand in an OfflinePool
+// (common/offline_pool.h): the pads and, for the receiver, the shuffled query permutations w.
+// Neither depends on the choices p or on m. PRP queries have no offline part worth pooling:
+// their randomness is one key.
+template <typename Messages>
+struct Precomputed {
+  typename Messages::pad_type r;
+  PermutationSet w;
+};
+
+// Fills item `sequence` of a pool with master seed master: the pads from
+// offline_seed(master, sequence, 0) and, when with_permutations (the receiver's pool), the
+// permutations from offline_seed(master, sequence, 1). A sender's pool and a receiver's pool
+// with the same master therefore hold the same pads item by item.
+template <typename Messages>
+void precompute(int n, int number_of_OT, unsigned int bit_size, const PrgSeed& master, uint64_t sequence, bool with_permutations, Precomputed<Messages>& item) {
+  Setup(number_of_OT, n, bit_size, item.r, offline_seed(master, sequence, 0));
+  if (with_permutations) {
+    shuffle_permutations(number_of_OT, n, item.w, (unsigned long)offline_seed(master, sequence, 1).w[0]);
+  } else {
+    item.w = PermutationSet();
+  }
+}
+
+// Two-party API. Each object holds one party's state for a batch of number_of_OT OTs over n
+// messages of bit_size bits; Messages is BlockMessages<Bits>, LazyBlockMessages<Bits> or
+// MpzMessages. Both parties expand the same pads from pad_seed, so setup() runs on each side
+// and nothing but the query and the response crosses between them.
+template <typename Messages>
+class Sender {
+public:
+  typedef typename Messages::vector_type vector_type;
+  typedef typename Messages::matrix_type matrix_type;
+  typedef typename Messages::pad_type pad_type;
+
+  Sender(int n, int number_of_OT, unsigned int bit_size, const PrgSeed& pad_seed)
+      : n_(n), number_of_OT_(number_of_OT), bit_size_(bit_size), pad_seed_(pad_seed) {}
+
+  // Phase 1
+  void setup() { Setup(number_of_OT_, n_, bit_size_, r_, pad_seed_); }
+
+  // Phase 1, offline: takes the pads of a pool item made by precompute(); item gets the
+  // previous pads back for the pool to refill
+  void setup(Precomputed<Messages>& item) { swap(r_, item.r); }
+
+  // Phase 3: the response to query w (a PermutationSet or a FeistelPrp key), from messages in
+  // memory or a mapped database
+  template <typename Query>
+  matrix_type respond(const vector_type& m, const Query& w) const {
+    return GenRes(m, number_of_OT_, r_, w);
+  }
+
+  template <unsigned Bits, typename Query>
+  matrix_type respond(const MappedDatabase<Bits>& m, const Query& w) const {
+    return GenRes(m, number_of_OT_, r_, w);
+  }
+
+  // Phase 3, pipelined: streams the response into ring chunk by chunk on the calling thread,
+  // for a Receiver::filter_stream running on another (see run_pipeline)
+  template <unsigned Bits, typename Query>
+  bool respond_stream(const BlockVector<Bits>& m, const Query& w, SpscRing<Block<Bits>>& ring) const {
+    return GenResStream(m.data(), m.size(), number_of_OT_, r_, w, ring);
+  }
+
+  template <unsigned Bits, typename Query>
+  bool respond_stream(const MappedDatabase<Bits>& m, const Query& w, SpscRing<Block<Bits>>& ring) const {
+    return GenResStream(m.data(), m.size(), number_of_OT_, r_, w, ring);
+  }
+
+  int n() const { return n_; }
+  int number_of_OT() const { return number_of_OT_; }
+  const pad_type& pads() const { return r_; }
+
+private:
+  int n_;
+  int number_of_OT_;
+  unsigned int bit_size_;
+  PrgSeed pad_seed_;
+  pad_type r_;
+};
+
+// Amortized multi-query sender: queues the batches of many receivers, each with its own
+// Sender (and so its own pads), and answers all of them with one shared scan over m instead
+// of one scan per receiver. Queries may mix both forms. Block messages only.
+template <typename Messages>
+class BatchSender {
+public:
+  typedef typename Messages::matrix_type matrix_type;
+  typedef typename Messages::pad_type pad_type;
+
+  explicit BatchSender(int n) : n_(n) {}
+
+  // Queues one receiver's query w against sender, which must be set up. sender and a
+  // PermutationSet w are referenced, not copied, until respond(); a PRP key is expanded into
+  // its round tables here. Returns false if sender serves a different n.
+  bool add(const Sender<Messages>& sender, const PermutationSet& w) {
+    if (!same_n(sender)) {
+      return false;
+    }
+    queries_.push_back(pending_query(sender.pads(), sender.number_of_OT(), w));
+    return true;
+  }
+
+  bool add(const Sender<Messages>& sender, const FeistelPrp& w) {
+    if (!same_n(sender)) {
+      return false;
+    }
+    keys_.push_back(unique_ptr<FeistelPrp>(new FeistelPrp(w)));
+    tables_.push_back(unique_ptr<PrpPositions>(new PrpPositions(*keys_.back(), sender.number_of_OT())));
+    queries_.push_back(pending_query(sender.pads(), sender.number_of_OT(), *tables_.back()));
+    return true;
+  }
+
+  size_t size() const { return queries_.size(); }
+
+  void clear() {
+    queries_.clear();
+    tables_.clear();
+    keys_.clear();
+  }
+
+  // Phase 3 for every queued query: responses in add() order
+  template <unsigned Bits>
+  vector<matrix_type> respond(const BlockVector<Bits>& m) const {
+    return GenResScan(m.data(), m.size(), queries_);
+  }
+
+  template <unsigned Bits>
+  vector<matrix_type> respond(const MappedDatabase<Bits>& m) const {
+    return GenResScan(m.data(), m.size(), queries_);
+  }
+
+private:
+  bool same_n(const Sender<Messages>& sender) const {
+    if (sender.n() != n_) {
+      cerr << "\n ** Error: every queued Sender must serve the same n" << endl;
+      return false;
+    }
+    return true;
+  }
+
+  int n_;
+  vector<PendingQuery<pad_type>> queries_;
+  vector<unique_ptr<FeistelPrp>> keys_;
+  vector<unique_ptr<PrpPositions>> tables_;
+};
+
+template <typename Messages>
+class Receiver {
+public:
+  typedef typename Messages::value_type value_type;
+  typedef typename Messages::vector_type vector_type;
+  typedef typename Messages::matrix_type matrix_type;
+  typedef typename Messages::pad_type pad_type;
+
+  Receiver(int n, int number_of_OT, int p_size, unsigned int bit_size, const PrgSeed& pad_seed)
+      : n_(n), number_of_OT_(number_of_OT), p_size_(p_size), bit_size_(bit_size), pad_seed_(pad_seed) {}
+
+  // Phase 1
+  void setup() { Setup(number_of_OT_, n_, bit_size_, r_, pad_seed_); }
+
+  // Phase 1, offline: takes the pads and permutations of a pool item made by precompute()
+  // with with_permutations, so that the next query() only looks up the positions of p
+  void setup(Precomputed<Messages>& item) {
+    swap(r_, item.r);
+    swap(w_, item.w);
+  }
+
+  // Phase 2: p[j] lists the t indices wanted in invocation j, in priority order. Returns the
+  // query for the sender and keeps the positions y for filtering the response. After
+  // setup(item) the permutations come from the item and seed is unused.
+  PermutationSet query(const vector<vector<int>>& p, unsigned long seed = random_device()()) {
+    p_ = p;
+    if (w_.count() == size_t(number_of_OT_) && w_.n() == size_t(n_)) {
+      y_.resize(number_of_OT_);
+      for (int i = 0; i < number_of_OT_; ++i) {
+        y_[i].resize(p_size_);
+      }
+      fill_positions(number_of_OT_, p_size_, p, w_, y_);
+      // swap rather than move: a moved-from FlatMatrix keeps its shape
+      PermutationSet w;
+      swap(w, w_);
+      return w;
+    }
+    return genQuery(number_of_OT_, p_size_, p, n_, y_, seed);
+  }
+
+  // Same, with the query sent as a PRP key
+  FeistelPrp query_prp(const vector<vector<int>>& p, const PrgSeed& seed = random_prg_seed()) {
+    p_ = p;
+    return genQueryPrp(number_of_OT_, p_size_, p, n_, y_, seed);
+  }
+
+  // Phase 4: the t masked messages of each invocation out of the sender's response
+  matrix_type filter(const matrix_type& response) const {
+    return oblFilter(number_of_OT_, p_size_, response, y_);
+  }
+
+  // Phase 4, pipelined: filters the chunks of Sender::respond_stream as they arrive
+  template <unsigned Bits>
+  matrix_type filter_stream(SpscRing<Block<Bits>>& ring) const {
+    return oblFilterStream(number_of_OT_, p_size_, n_, ring, y_);
+  }
+
+  // Phase 5: message p[k][j], the j-th choice of invocation k
+  value_type retrieve(const matrix_type& filtered, int k, int j) const {
+    return retreive(filtered[k][j], j, r_[k], p_[k]);
+  }
+
+  typedef decltype(row_of(declval<const pad_type&>(), size_t(0))) pad_row;
+
+  // Phases 4 and 5, lazily: invocation k's choices in priority order, each decrypted from the
+  // response only when the consumer advances to it. Refers to response and this Receiver.
+  OrderedRetrieval<value_type, pad_row> ordered(const matrix_type& response, int k) const {
+    return ordered_retrieval(row_of(response, k), y_[k].data(), row_of(r_, k), p_[k].data(), p_size_);
+  }
+
+  // Phases 4 and 5 for the whole batch: out[k][j] = m[p[k][j]], read from the response through
+  // y with one gather and one vector XOR per invocation
+  void retrieve_all(const matrix_type& response, matrix_type& out) const {
+    shape_rows(out, number_of_OT_, p_size_);
+    retreiveAll(number_of_OT_, p_size_, response, y_, r_, p_, out);
+  }
+
+  int n() const { return n_; }
+  int number_of_OT() const { return number_of_OT_; }
+  int p_size() const { return p_size_; }
+
+private:
+  int n_;
+  int number_of_OT_;
+  int p_size_;
+  unsigned int bit_size_;
+  PrgSeed pad_seed_;
+  pad_type r_;
+  vector<vector<int>> p_;
+  vector<vector<int>> y_;
+  PermutationSet w_;  // precomputed permutations, until query() hands them out
+};
+
+// Reusable working memory for a stream of batches of one configuration, with both parties in
+// one process. The pads, the positions y, the response, the filtered and the retrieved
+// messages are regions of one Arena sized once from (n, number_of_OT, t); the query
+// permutations (or the PRP round tables) are kept from the first batch that needs them. A
+// batch after the first therefore performs no heap allocation. Each phase writes into its
+// region and returns a view of it, valid until the next begin(). Block messages only: Messages
+// is BlockMessages<Bits> or LazyBlockMessages<Bits>.
+template <typename Messages>
+class Context {
+public:
+  typedef typename Messages::value_type value_type;
+  typedef typename Messages::vector_type vector_type;
+  typedef ArenaPads<typename Messages::pad_type> arena_pads;
+  typedef typename arena_pads::type pad_type;
+
+  Context(int n, int number_of_OT, int p_size, unsigned int bit_size)
+      : n_(n), number_of_OT_(number_of_OT), p_size_(p_size), bit_size_(bit_size), key_(PrgSeed(), n) {
+    arena_.reserve(arena_bytes(n, number_of_OT, p_size));
+    invocations_.reserve(number_of_OT);
+    begin();
+  }
+
+  // Arena bytes of one batch
+  static size_t arena_bytes(int n, int number_of_OT, int p_size) {
+    const size_t chosen = size_t(number_of_OT) * p_size;
+    return arena_pads::bytes(number_of_OT, n) + Arena::bytes_for<int>(chosen) +
+           Arena::bytes_for<value_type>(size_t(number_of_OT) * n) + 2 * Arena::bytes_for<value_type>(chosen) +
+           Arena::bytes_for<uint64_t>(size_t(number_of_OT) * inverse_check_words(n));
+  }
+
+  // Starts a batch; the views of the previous one are handed out again
+  void begin() {
+    arena_.reset();
+    r_ = arena_pads::take(arena_, number_of_OT_, n_);
+    y_ = arena_.take_matrix<int>(number_of_OT_, p_size_);
+    response_ = arena_.take_matrix<value_type>(number_of_OT_, n_);
+    filtered_ = arena_.take_matrix<value_type>(number_of_OT_, p_size_);
+    out_ = arena_.take_matrix<value_type>(number_of_OT_, p_size_);
+    seen_ = arena_.take_matrix<uint64_t>(number_of_OT_, inverse_check_words(n_));
+  }
+
+  // Phase 1, for both parties
+  void setup(const PrgSeed& pad_seed) { Setup(number_of_OT_, n_, bit_size_, r_, pad_seed); }
+
+  // Phase 2: p[j] lists the t indices wanted in invocation j, in priority order. Returns the
+  // query for the sender and keeps the positions y for filter().
+  const PermutationSet& query(const vector<vector<int>>& p, unsigned long seed = random_device()()) {
+    genQuery(number_of_OT_, p_size_, p, n_, w_, y_, seed);
+    return w_;
+  }
+
+  // Same, with the query sent as a PRP key
+  FeistelPrp query_prp(const vector<vector<int>>& p, const PrgSeed& seed = random_prg_seed()) {
+    return genQueryPrp(number_of_OT_, p_size_, p, n_, y_, seed);
+  }
+
+  // Phase 3: the response to query w, from messages in memory or a mapped database; an empty
+  // view if the query is invalid
+  template <typename Query>
+  MatrixView<const value_type> respond(const vector_type& m, const Query& w) {
+    return respond(m.data(), m.size(), w);
+  }
+
+  template <unsigned Bits, typename Query>
+  MatrixView<const value_type> respond(const MappedDatabase<Bits>& m, const Query& w) {
+    return respond(m.data(), m.size(), w);
+  }
+
+  // Phase 4: the t masked messages of each invocation
+  MatrixView<const value_type> filter(const MatrixView<const value_type>& response) {
+    if (response.rows() < size_t(number_of_OT_) || response.cols() != size_t(n_)) {
+      return MatrixView<const value_type>();
+    }
+    oblFilter(number_of_OT_, p_size_, response, MatrixView<const int>(y_), filtered_);
+    return filtered_;
+  }
+
+  // Phase 5: out[k][j] = m[p[k][j]], the j-th choice of invocation k
+  MatrixView<const value_type> retrieve(const MatrixView<const value_type>& filtered, const vector<vector<int>>& p) {
+    retreiveAll(number_of_OT_, p_size_, filtered, r_, p, out_);
+    return out_;
+  }
+
+  typedef decltype(row_of(declval<const pad_type&>(), size_t(0))) pad_row;
+
+  // Phases 4 and 5, lazily, for invocation k: see Receiver::ordered
+  OrderedRetrieval<value_type, pad_row> ordered(const MatrixView<const value_type>& response, int k, const vector<vector<int>>& p) const {
+    return ordered_retrieval(response[k], y_[k], row_of(r_, k), p[k].data(), p_size_);
+  }
+
+  // Phases 4 and 5 for the whole batch, straight from the response: see Receiver::retrieve_all
+  MatrixView<const value_type> retrieve_all(const MatrixView<const value_type>& response, const vector<vector<int>>& p) {
+    retreiveAll(number_of_OT_, p_size_, response, y_, r_, p, out_);
+    return out_;
+  }
+
+  int n() const { return n_; }
+  int number_of_OT() const { return number_of_OT_; }
+  int p_size() const { return p_size_; }
+  size_t arena_capacity() const { return arena_.capacity(); }
+
+private:
+  MatrixView<const value_type> respond(const value_type* m, size_t m_size, const PendingQuery<pad_type>& query) {
+    if (m_size != size_t(n_) || !GenResScan(m, m_size, &query, &response_, 1, invocations_)) {
+      return MatrixView<const value_type>();
+    }
+    return response_;
+  }
+
+  MatrixView<const value_type> respond(const value_type* m, size_t m_size, const PermutationSet& w) {
+    return respond(m, m_size, pending_query(r_, number_of_OT_, w, seen_));
+  }
+
+  // A PRP key is expanded into round tables that are refilled in place from the second batch on
+  MatrixView<const value_type> respond(const value_type* m, size_t m_size, const FeistelPrp& w) {
+    if (w.size() != uint64_t(n_)) {
+      cerr << "\n ** Error: the PRP key must permute [0, n)" << endl;
+      return MatrixView<const value_type>();
+    }
+    key_ = w;
+    if (tables_) {
+      tables_->tabulate();
+    } else {
+      tables_.reset(new PrpPositions(key_, number_of_OT_));
+    }
+    return respond(m, m_size, pending_query(r_, number_of_OT_, *tables_));
+  }
+
+  Context(const Context&);
+  Context& operator=(const Context&);
+
+  int n_;
+  int number_of_OT_;
+  int p_size_;
+  unsigned int bit_size_;
+  Arena arena_;
+  pad_type r_;
+  MatrixView<int> y_;
+  MatrixView<value_type> response_;
+  MatrixView<value_type> filtered_;
+  MatrixView<value_type> out_;
+  MatrixView<uint64_t> seen_;
+  PermutationSet w_;
+  FeistelPrp key_;
+  unique_ptr<PrpPositions> tables_;
+  vector<QueryInvocation> invocations_;
+};
+
+} // namespace priority
+
+#endif
@@ -0,0 +1,56 @@
+// Counting replacements of the global operator new / delete and of GMP's allocation
+// functions, for common/alloc_counter.h. Linked only into programs that count every heap
+// allocation (ot_bench); the other targets keep the default allocator. operator new and
+// delete here are plain malloc and free, so memory from either side may be freed by the other.
+
+#include <cstdlib>
+#include <new>
+#include <gmp.h>
+#include "../common/alloc_counter.h"
+
+void* operator new(std::size_t size) {
+  count_heap_allocation();
+  void* p = malloc(size == 0 ? 1 : size);
+  if (p == nullptr) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+void* operator new[](std::size_t size) { return operator new(size); }
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+  count_heap_allocation();
+  return malloc(size == 0 ? 1 : size);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t& tag) noexcept { return operator new(size, tag); }
+
+void operator delete(void* p) noexcept { free(p); }
+void operator delete[](void* p) noexcept { free(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { free(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { free(p); }
+
+namespace {
+
+void* gmp_alloc(size_t size) {
+  count_heap_allocation();
+  return malloc(size);
+}
+
+void* gmp_realloc(void* p, size_t, size_t size) {
+  count_heap_allocation();
+  return realloc(p, size);
+}
+
+void gmp_free(void* p, size_t) { free(p); }
+
+// GMP's default functions are malloc/realloc/free too, so limbs allocated before this runs
+// are still freed correctly
+struct GmpHook {
+  GmpHook() { mp_set_memory_functions(gmp_alloc, gmp_realloc, gmp_free); }
+};
+
+GmpHook gmp_hook;
+
+} // namespace
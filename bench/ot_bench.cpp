@@ -0,0 +1,822 @@
+// End-to-end benchmark of Helix OT and Priority OT through the Sender/Receiver API. Runs every
+// combination of the listed n, t, batch sizes (invocations per batch) and bit widths, and
+// prints one row per configuration, as CSV or JSON: min / median / p99 wall-clock time of each
+// phase (common/phase_bench.h), throughput, and whether every retrieved message was correct.
+//
+//   cmake -S . -B build && cmake --build build --target ot_bench
+//   ./build/ot_bench --protocol all --n 256,4096,65536 --t 10 --batch 1,16 --bits 128,256
+//
+// Options (lists are comma-separated):
+//   --protocol helix|priority|all   default all
+//   --n LIST                        messages per batch, default 256,4096
+//   --t LIST                        Priority OT choices per invocation, default 10
+//   --batch LIST                    invocations per batch, default 1
+//   --bits LIST                     64, 128, 256, 512 or 1024, default 128
+//   --pads stored|lazy              stored pads or seed-compressed pads, default stored
+//   --query perm|prp                Priority OT query form, default perm
+//   --mode batch|pipeline           whole response then filter, or the response streamed
+//                                   through a ring into the filter on a second thread;
+//                                   default batch
+//   --receivers LIST                receivers, each with its own batch and pads, default 1
+//   --sender shared|separate        with several receivers: one BatchSender scan over m for
+//                                   all of them, or one scan per receiver; default shared
+//   --context on|off                run each receiver's batches through one reusable
+//                                   Context (arena sized once) instead of fresh Sender and
+//                                   Receiver objects; batch mode, one scan per receiver;
+//                                   default off
+//   --retrieval filter|batch|lazy   Priority OT phases 4 and 5: OblFilter then Retrieve,
+//                                   one batch gather + XOR straight from the response, or
+//                                   the ordered lazy iterator read up to --consume choices
+//                                   per invocation; batch mode only, default filter
+//   --consume N                     choices the lazy consumer reads per invocation before
+//                                   stopping early, default 1
+//   --offline on|off                take each batch's pads and query randomness from
+//                                   background-filled pools (common/offline_pool.h), so
+//                                   the timed phases are the online path only; fresh
+//                                   objects, batch or pipeline mode; default off
+//   --pool N                        items per offline pool, default 4
+//   --idle-ms N                     untimed pause before each batch, the idle time the
+//                                   pools refill in; default 0
+//   --reps N                        timed repetitions per configuration, default 5
+//   --warmup N                      untimed repetitions first, default 1
+//   --format csv|json               default csv
+//   --trace PATH                    in an OT_TRACE build (cmake -DOT_TRACE=ON): print the
+//                                   trace counters of each configuration's timed runs to
+//                                   stderr and write their spans to PATH as Chrome
+//                                   trace-event JSON (the last configuration's, when there
+//                                   are several)
+//
+// Setup is timed on the sender only; the receiver expands the same pads outside the timer.
+// In pipeline mode GenRes and OblFilter overlap, so the respond column covers both and
+// filter is only the hand-over. With --retrieval batch or lazy there is no OblFilter and the
+// retrieve column covers phases 4 and 5.
+//
+// With --offline on, pool_misses counts the batches that found a pool empty and waited in
+// Setup (or, for the receiver, untimed) for the producer, and refill_per_s is the rate the
+// producers make items at.
+//
+// Every heap allocation is counted (common/alloc_counter.h, with the operator new and GMP
+// hooks of bench/alloc_hooks.cpp linked in): allocs_per_batch is the most any batch after
+// the first made between its Setup and its Retrieve. With --context on a batch after the
+// first must not allocate at all, and ok is 0 if one does.
+
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <gmpxx.h>
+#include "../Helix-OT--1-out-of-n-OT/helix_ot.h"
+#include "../Priority-OT--ordered-t-out-of-n-OT/priority_ot.h"
+#include "../common/phase_bench.h"
+#include "../common/offline_pool.h"
+using namespace std;
+
+struct Config {
+  string protocol;
+  int n;
+  int t;
+  int batch;
+  unsigned bits;
+  string pads;
+  string query;
+  string mode;
+  int receivers;
+  string sender;
+  string context;
+  string retrieval;
+  int consume;
+  string offline;
+  int pool;
+  int idle_ms;
+  int reps;
+  int warmup;
+};
+
+// Several receivers (--receivers) each run their own batch against their own Sender; with
+// --sender shared their queries are answered by one BatchSender scan over m.
+bool shared_sender(const Config& c) { return c.receivers > 1 && c.sender == "shared"; }
+
+// Heap allocations of one batch, from just after bench.begin() to its last lap; the first
+// batch of a configuration fills caches and pools and is not counted
+struct AllocStats {
+  uint64_t max_per_batch;
+  uint64_t start;
+
+  void begin() { start = heap_allocations(); }
+
+  // Records the batch; false if a steady-state batch allocated where none may
+  bool end(int rep, bool must_be_zero) {
+    uint64_t made = heap_allocations() - start;
+    if (rep == 0) {
+      return true;
+    }
+    max_per_batch = max(max_per_batch, made);
+    return !must_be_zero || made == 0;
+  }
+};
+
+// Offline pools of every receiver: both parties' pools of receiver k share one master seed
+struct PoolStats {
+  uint64_t misses;
+  uint64_t produced;
+  double produce_seconds;
+
+  template <typename Pool>
+  void add(const vector<unique_ptr<Pool>>& pools) {
+    for (size_t k = 0; k < pools.size(); ++k) {
+      PoolMetrics m = pools[k]->metrics();
+      misses += m.misses;
+      produced += m.produced;
+      produce_seconds += m.produce_seconds;
+    }
+  }
+
+  // Items per second of producer time, over every pool
+  double refill_per_s() const { return produce_seconds > 0 ? produced / produce_seconds : 0; }
+};
+
+// One sender pool and one receiver pool per receiver when --offline is on
+template <typename Item>
+void make_pools(const Config& c, vector<unique_ptr<OfflinePool<Item>>>& sender_pools, vector<unique_ptr<OfflinePool<Item>>>& receiver_pools) {
+  if (c.offline != "on") {
+    return;
+  }
+  for (int k = 0; k < c.receivers; ++k) {
+    const PrgSeed master = random_prg_seed();
+    const Config config = c;
+    for (int side = 0; side < 2; ++side) {
+      const bool receiver_side = side == 1;
+      // A PRP query's only randomness is its key: nothing to shuffle ahead
+      const bool with_randomness = receiver_side && c.query != "prp";
+      typename OfflinePool<Item>::Produce produce = [config, master, with_randomness](Item& item, uint64_t sequence) {
+        precompute(config.n, config.batch, config.bits, master, sequence, with_randomness, item);
+      };
+      (receiver_side ? receiver_pools : sender_pools).emplace_back(new OfflinePool<Item>(config.pool, produce));
+    }
+  }
+}
+
+void idle(const Config& c) {
+  if (c.idle_ms > 0) {
+    this_thread::sleep_for(chrono::milliseconds(c.idle_ms));
+  }
+}
+
+// Holds every pool paused across one batch's online path, so refills run in idle() only
+template <typename Pool>
+void pause_pools(const vector<unique_ptr<Pool>>& a, const vector<unique_ptr<Pool>>& b, bool paused) {
+  for (size_t k = 0; k < a.size(); ++k) {
+    paused ? a[k]->pause() : a[k]->resume();
+    paused ? b[k]->pause() : b[k]->resume();
+  }
+}
+
+template <typename Messages>
+bool bench_helix(const Config& c, PhaseBench& bench, AllocStats& allocs, PoolStats& pools) {
+  if (c.n <= 0 || (c.n & (c.n - 1)) != 0) {
+    cerr << "skipping helix n=" << c.n << ": n must be a power of two" << endl;
+    return false;
+  }
+  typedef typename Messages::vector_type vector_type;
+  typedef typename Messages::matrix_type matrix_type;
+  gmp_randclass rng(gmp_randinit_default);
+  rng.seed(1);
+  vector_type m(c.n);
+  for (int i = 0; i < c.n; ++i) {
+    helix::generate_random_bigint(rng, c.bits, m[i]);
+  }
+  const int receivers = c.receivers;
+  vector<vector<int>> indices(receivers);
+  for (int k = 0; k < receivers; ++k) {
+    indices[k] = helix::generateRandomIntegers(c.batch, c.n - 1);
+  }
+  vector<vector_type> out(receivers);
+  typedef helix::Precomputed<Messages> Item;
+  vector<unique_ptr<OfflinePool<Item>>> sender_pools, receiver_pools;
+  make_pools(c, sender_pools, receiver_pools);
+  Item item;
+  for (int rep = 0; rep < bench.total_iterations(); ++rep) {
+    idle(c);
+    pause_pools(sender_pools, receiver_pools, true);
+    vector<unique_ptr<helix::Sender<Messages>>> senders;
+    vector<unique_ptr<helix::Receiver<Messages>>> receiver;
+    for (int k = 0; k < receivers; ++k) {
+      PrgSeed pad_seed = random_prg_seed();
+      senders.emplace_back(new helix::Sender<Messages>(c.n, c.batch, c.bits, pad_seed));
+      receiver.emplace_back(new helix::Receiver<Messages>(c.n, c.batch, c.bits, pad_seed));
+      if (c.offline == "on") {
+        receiver_pools[k]->take(item);
+        receiver[k]->setup(item);
+      } else {
+        receiver[k]->setup();
+      }
+    }
+    bench.begin();
+    allocs.begin();
+    for (int k = 0; k < receivers; ++k) {
+      if (c.offline == "on") {
+        sender_pools[k]->take(item);
+        senders[k]->setup(item);
+      } else {
+        senders[k]->setup();
+      }
+    }
+    bench.lap(kPhaseSetup);
+    vector<vector<uint64_t>> share1(receivers);
+    for (int k = 0; k < receivers; ++k) {
+      share1[k] = receiver[k]->query(indices[k]);
+    }
+    bench.lap(kPhaseGenQuery);
+    vector<vector_type> filtered(receivers);
+    if (c.mode == "pipeline") {
+      typedef typename Messages::value_type Message;
+      for (int k = 0; k < receivers; ++k) {
+        SpscRing<Message> ring(kRingSlots, ring_slot_len(c.n, sizeof(Message)));
+        run_pipeline([&] { senders[k]->respond_stream(m, share1[k], ring); },
+                     [&] { filtered[k] = receiver[k]->filter_stream(ring); });
+      }
+      bench.lap(kPhaseGenRes);
+    } else {
+      vector<matrix_type> responses(receivers);
+      if (shared_sender(c)) {
+        helix::BatchSender<Messages> batch(c.n);
+        for (int k = 0; k < receivers; ++k) {
+          batch.add(*senders[k], share1[k]);
+        }
+        responses = batch.respond(m);
+      } else {
+        for (int k = 0; k < receivers; ++k) {
+          responses[k] = senders[k]->respond(m, share1[k]);
+        }
+      }
+      bench.lap(kPhaseGenRes);
+      for (int k = 0; k < receivers; ++k) {
+        filtered[k] = receiver[k]->filter(responses[k]);
+      }
+    }
+    bench.lap(kPhaseOblFilter);
+    for (int k = 0; k < receivers; ++k) {
+      receiver[k]->retrieve(filtered[k], out[k]);
+    }
+    bench.lap(kPhaseRetrieve);
+    allocs.end(rep, false);
+    for (int k = 0; k < receivers; ++k) {
+      for (int j = 0; j < c.batch; ++j) {
+        bench.check(out[k][j] == m[indices[k][j]]);
+      }
+    }
+    bench.end();
+    pause_pools(sender_pools, receiver_pools, false);
+  }
+  pools.add(receiver_pools);
+  pools.add(sender_pools);
+  return true;
+}
+
+// Priority OT phases 3 and 4 for every receiver, batched, pipelined or through one BatchSender.
+// Without OblFilter (--retrieval batch|lazy) the responses are left for Retrieve.
+template <typename Messages, typename Query>
+void respond_and_filter(const Config& c, const vector<unique_ptr<priority::Sender<Messages>>>& senders,
+                        const vector<unique_ptr<priority::Receiver<Messages>>>& receiver,
+                        const typename Messages::vector_type& m, const vector<Query>& w,
+                        vector<typename Messages::matrix_type>& responses,
+                        vector<typename Messages::matrix_type>& filtered, PhaseBench& bench) {
+  const size_t receivers = senders.size();
+  if (c.mode == "pipeline") {
+    typedef typename Messages::value_type Message;
+    for (size_t k = 0; k < receivers; ++k) {
+      SpscRing<Message> ring(kRingSlots, ring_slot_len(c.n, sizeof(Message)));
+      run_pipeline([&] { senders[k]->respond_stream(m, w[k], ring); },
+                   [&] { filtered[k] = receiver[k]->filter_stream(ring); });
+    }
+    bench.lap(kPhaseGenRes);
+    return;
+  }
+  if (shared_sender(c)) {
+    priority::BatchSender<Messages> batch(c.n);
+    for (size_t k = 0; k < receivers; ++k) {
+      batch.add(*senders[k], w[k]);
+    }
+    responses = batch.respond(m);
+  } else {
+    for (size_t k = 0; k < receivers; ++k) {
+      responses[k] = senders[k]->respond(m, w[k]);
+    }
+  }
+  bench.lap(kPhaseGenRes);
+  if (c.retrieval != "filter") {
+    return;
+  }
+  for (size_t k = 0; k < receivers; ++k) {
+    filtered[k] = receiver[k]->filter(responses[k]);
+  }
+}
+
+// Consumed choices checked per invocation: all t, or the first --consume with the lazy iterator
+int checked_choices(const Config& c) { return c.retrieval == "lazy" ? min(c.consume, c.t) : c.t; }
+
+// Reads the first `consume` choices of one ordered retrieval, then stops
+template <typename Ordered, typename Message>
+void consume_ordered(const Ordered& ordered, int consume, Message* out) {
+  for (typename Ordered::iterator it = ordered.begin(); it != ordered.end() && it.priority() < consume; ++it) {
+    out[it.priority()] = *it;
+  }
+}
+
+template <typename Messages>
+bool bench_priority(const Config& c, PhaseBench& bench, AllocStats& allocs, PoolStats& pools) {
+  if (c.t <= 0 || c.t > c.n) {
+    cerr << "skipping priority n=" << c.n << " t=" << c.t << ": t must be in [1, n]" << endl;
+    return false;
+  }
+  gmp_randclass rng(gmp_randinit_default);
+  rng.seed(1);
+  typename Messages::vector_type m(c.n);
+  for (int i = 0; i < c.n; ++i) {
+    priority::generate_random_bigint(rng, c.bits, m[i]);
+  }
+  const int receivers = c.receivers;
+  vector<vector<vector<int>>> p(receivers);
+  for (int k = 0; k < receivers; ++k) {
+    p[k] = priority::generateRandomVectors(c.t, c.batch, c.n);
+  }
+  typename Messages::vector_type out(size_t(receivers) * c.batch * c.t);
+  typedef priority::Precomputed<Messages> Item;
+  vector<unique_ptr<OfflinePool<Item>>> sender_pools, receiver_pools;
+  make_pools(c, sender_pools, receiver_pools);
+  Item item;
+  for (int rep = 0; rep < bench.total_iterations(); ++rep) {
+    idle(c);
+    pause_pools(sender_pools, receiver_pools, true);
+    vector<unique_ptr<priority::Sender<Messages>>> senders;
+    vector<unique_ptr<priority::Receiver<Messages>>> receiver;
+    for (int k = 0; k < receivers; ++k) {
+      PrgSeed pad_seed = random_prg_seed();
+      senders.emplace_back(new priority::Sender<Messages>(c.n, c.batch, c.bits, pad_seed));
+      receiver.emplace_back(new priority::Receiver<Messages>(c.n, c.batch, c.t, c.bits, pad_seed));
+      if (c.offline == "on") {
+        receiver_pools[k]->take(item);
+        receiver[k]->setup(item);
+      } else {
+        receiver[k]->setup();
+      }
+    }
+    bench.begin();
+    allocs.begin();
+    for (int k = 0; k < receivers; ++k) {
+      if (c.offline == "on") {
+        sender_pools[k]->take(item);
+        senders[k]->setup(item);
+      } else {
+        senders[k]->setup();
+      }
+    }
+    bench.lap(kPhaseSetup);
+    vector<typename Messages::matrix_type> responses(receivers), filtered(receivers), all(receivers);
+    if (c.query == "prp") {
+      vector<FeistelPrp> w;
+      for (int k = 0; k < receivers; ++k) {
+        w.push_back(receiver[k]->query_prp(p[k]));
+      }
+      bench.lap(kPhaseGenQuery);
+      respond_and_filter<Messages>(c, senders, receiver, m, w, responses, filtered, bench);
+    } else {
+      vector<PermutationSet> w(receivers);
+      for (int k = 0; k < receivers; ++k) {
+        w[k] = receiver[k]->query(p[k]);
+      }
+      bench.lap(kPhaseGenQuery);
+      respond_and_filter<Messages>(c, senders, receiver, m, w, responses, filtered, bench);
+    }
+    bench.lap(kPhaseOblFilter);
+    for (int k = 0; k < receivers; ++k) {
+      if (c.retrieval == "batch") {
+        receiver[k]->retrieve_all(responses[k], all[k]);
+        continue;
+      }
+      for (int i = 0; i < c.batch; ++i) {
+        if (c.retrieval == "lazy") {
+          consume_ordered(receiver[k]->ordered(responses[k], i), c.consume, &out[(size_t(k) * c.batch + i) * c.t]);
+          continue;
+        }
+        for (int j = 0; j < c.t; ++j) {
+          out[(size_t(k) * c.batch + i) * c.t + j] = receiver[k]->retrieve(filtered[k], i, j);
+        }
+      }
+    }
+    bench.lap(kPhaseRetrieve);
+    allocs.end(rep, false);
+    for (int k = 0; k < receivers; ++k) {
+      for (int i = 0; i < c.batch; ++i) {
+        for (int j = 0; j < checked_choices(c); ++j) {
+          bool batch = c.retrieval == "batch";
+          bench.check((batch ? all[k][i][j] : out[(size_t(k) * c.batch + i) * c.t + j]) == m[p[k][i][j]]);
+        }
+      }
+    }
+    bench.end();
+    pause_pools(sender_pools, receiver_pools, false);
+  }
+  pools.add(receiver_pools);
+  pools.add(sender_pools);
+  return true;
+}
+
+// Helix OT through one helix::Context per receiver, created once per configuration
+template <typename Messages>
+bool bench_helix_context(const Config& c, PhaseBench& bench, AllocStats& allocs, PoolStats& pools) {
+  typedef typename Messages::value_type Message;
+  gmp_randclass rng(gmp_randinit_default);
+  rng.seed(1);
+  typename Messages::vector_type m(c.n);
+  for (int i = 0; i < c.n; ++i) {
+    helix::generate_random_bigint(rng, c.bits, m[i]);
+  }
+  const int receivers = c.receivers;
+  vector<vector<int>> indices(receivers);
+  vector<unique_ptr<helix::Context<Messages>>> contexts;
+  for (int k = 0; k < receivers; ++k) {
+    indices[k] = helix::generateRandomIntegers(c.batch, c.n - 1);
+    contexts.emplace_back(new helix::Context<Messages>(c.n, c.batch, c.bits));
+  }
+  vector<PrgSeed> pad_seeds(receivers);
+  vector<const uint64_t*> share1(receivers);
+  vector<MatrixView<const Message>> responses(receivers);
+  vector<const Message*> filtered(receivers), out(receivers);
+  for (int rep = 0; rep < bench.total_iterations(); ++rep) {
+    for (int k = 0; k < receivers; ++k) {
+      pad_seeds[k] = random_prg_seed();
+    }
+    bench.begin();
+    allocs.begin();
+    for (int k = 0; k < receivers; ++k) {
+      contexts[k]->begin();
+      contexts[k]->setup(pad_seeds[k]);
+    }
+    bench.lap(kPhaseSetup);
+    for (int k = 0; k < receivers; ++k) {
+      share1[k] = contexts[k]->query(indices[k]);
+    }
+    bench.lap(kPhaseGenQuery);
+    for (int k = 0; k < receivers; ++k) {
+      responses[k] = contexts[k]->respond(m, share1[k]);
+    }
+    bench.lap(kPhaseGenRes);
+    for (int k = 0; k < receivers; ++k) {
+      filtered[k] = contexts[k]->filter(responses[k]);
+    }
+    bench.lap(kPhaseOblFilter);
+    for (int k = 0; k < receivers; ++k) {
+      out[k] = filtered[k] != nullptr ? contexts[k]->retrieve(filtered[k], indices[k]) : nullptr;
+    }
+    bench.lap(kPhaseRetrieve);
+    bench.check(allocs.end(rep, true));
+    for (int k = 0; k < receivers; ++k) {
+      for (int j = 0; j < c.batch; ++j) {
+        bench.check(out[k] != nullptr && out[k][j] == m[indices[k][j]]);
+      }
+    }
+    bench.end();
+  }
+  return true;
+}
+
+// Priority OT through one priority::Context per receiver, created once per configuration
+template <typename Messages>
+bool bench_priority_context(const Config& c, PhaseBench& bench, AllocStats& allocs, PoolStats& pools) {
+  typedef typename Messages::value_type Message;
+  if (c.t <= 0 || c.t > c.n) {
+    cerr << "skipping priority n=" << c.n << " t=" << c.t << ": t must be in [1, n]" << endl;
+    return false;
+  }
+  gmp_randclass rng(gmp_randinit_default);
+  rng.seed(1);
+  typename Messages::vector_type m(c.n);
+  for (int i = 0; i < c.n; ++i) {
+    priority::generate_random_bigint(rng, c.bits, m[i]);
+  }
+  const int receivers = c.receivers;
+  vector<vector<vector<int>>> p(receivers);
+  vector<unique_ptr<priority::Context<Messages>>> contexts;
+  for (int k = 0; k < receivers; ++k) {
+    p[k] = priority::generateRandomVectors(c.t, c.batch, c.n);
+    contexts.emplace_back(new priority::Context<Messages>(c.n, c.batch, c.t, c.bits));
+  }
+  vector<PrgSeed> pad_seeds(receivers);
+  vector<const PermutationSet*> w(receivers);
+  vector<FeistelPrp> keys;
+  keys.reserve(receivers);
+  vector<MatrixView<const Message>> responses(receivers), filtered(receivers), out(receivers);
+  // Choices read by the lazy consumer, sized once
+  vector<typename Messages::vector_type> consumed(receivers, typename Messages::vector_type(size_t(c.batch) * c.t));
+  for (int rep = 0; rep < bench.total_iterations(); ++rep) {
+    for (int k = 0; k < receivers; ++k) {
+      pad_seeds[k] = random_prg_seed();
+    }
+    bench.begin();
+    allocs.begin();
+    for (int k = 0; k < receivers; ++k) {
+      contexts[k]->begin();
+      contexts[k]->setup(pad_seeds[k]);
+    }
+    bench.lap(kPhaseSetup);
+    keys.clear();
+    for (int k = 0; k < receivers; ++k) {
+      if (c.query == "prp") {
+        keys.push_back(contexts[k]->query_prp(p[k]));
+      } else {
+        w[k] = &contexts[k]->query(p[k]);
+      }
+    }
+    bench.lap(kPhaseGenQuery);
+    for (int k = 0; k < receivers; ++k) {
+      responses[k] = c.query == "prp" ? contexts[k]->respond(m, keys[k]) : contexts[k]->respond(m, *w[k]);
+    }
+    bench.lap(kPhaseGenRes);
+    for (int k = 0; k < receivers; ++k) {
+      filtered[k] = c.retrieval == "filter" ? contexts[k]->filter(responses[k]) : responses[k];
+    }
+    bench.lap(kPhaseOblFilter);
+    for (int k = 0; k < receivers; ++k) {
+      out[k] = filtered[k];
+      if (filtered[k].rows() == 0) {
+        continue;
+      }
+      if (c.retrieval == "filter") {
+        out[k] = contexts[k]->retrieve(filtered[k], p[k]);
+      } else if (c.retrieval == "batch") {
+        out[k] = contexts[k]->retrieve_all(responses[k], p[k]);
+      } else {
+        for (int i = 0; i < c.batch; ++i) {
+          consume_ordered(contexts[k]->ordered(responses[k], i, p[k]), c.consume, &consumed[k][size_t(i) * c.t]);
+        }
+      }
+    }
+    bench.lap(kPhaseRetrieve);
+    bench.check(allocs.end(rep, true));
+    for (int k = 0; k < receivers; ++k) {
+      for (int i = 0; i < c.batch; ++i) {
+        for (int j = 0; j < checked_choices(c); ++j) {
+          bool lazy = c.retrieval == "lazy";
+          bench.check(out[k].rows() != 0 && (lazy ? consumed[k][size_t(i) * c.t + j] : out[k][i][j]) == m[p[k][i][j]]);
+        }
+      }
+    }
+    bench.end();
+  }
+  return true;
+}
+
+template <typename Messages>
+bool bench_messages(const Config& c, PhaseBench& bench, AllocStats& allocs, PoolStats& pools) {
+  if (c.context == "on") {
+    return c.protocol == "helix" ? bench_helix_context<Messages>(c, bench, allocs, pools)
+                                 : bench_priority_context<Messages>(c, bench, allocs, pools);
+  }
+  return c.protocol == "helix" ? bench_helix<Messages>(c, bench, allocs, pools) : bench_priority<Messages>(c, bench, allocs, pools);
+}
+
+template <unsigned Bits>
+bool bench_bits(const Config& c, PhaseBench& bench, AllocStats& allocs, PoolStats& pools) {
+  if (c.pads == "lazy") {
+    return bench_messages<LazyBlockMessages<Bits> >(c, bench, allocs, pools);
+  }
+  return bench_messages<BlockMessages<Bits> >(c, bench, allocs, pools);
+}
+
+bool run(const Config& c, PhaseBench& bench, AllocStats& allocs, PoolStats& pools) {
+  if (c.offline == "on" && c.context == "on") {
+    cerr << "skipping --offline on: pools feed fresh Sender and Receiver objects, not a Context" << endl;
+    return false;
+  }
+  if (c.protocol == "priority" && c.retrieval != "filter" && c.mode != "batch") {
+    cerr << "skipping --retrieval " << c.retrieval << ": the response is only kept whole in batch mode" << endl;
+    return false;
+  }
+  if (c.context == "on" && (c.mode != "batch" || shared_sender(c))) {
+    cerr << "skipping --context on: a Context runs batch mode with one scan per receiver (--sender separate)" << endl;
+    return false;
+  }
+  if (c.context == "on" && c.protocol == "helix" && (c.n <= 0 || (c.n & (c.n - 1)) != 0)) {
+    cerr << "skipping helix n=" << c.n << ": n must be a power of two" << endl;
+    return false;
+  }
+  switch (c.bits) {
+    case 64: return bench_bits<64>(c, bench, allocs, pools);
+    case 128: return bench_bits<128>(c, bench, allocs, pools);
+    case 256: return bench_bits<256>(c, bench, allocs, pools);
+    case 512: return bench_bits<512>(c, bench, allocs, pools);
+    case 1024: return bench_bits<1024>(c, bench, allocs, pools);
+  }
+  cerr << "skipping bits=" << c.bits << ": supported widths are 64, 128, 256, 512, 1024" << endl;
+  return false;
+}
+
+vector<int> parse_list(const string& text) {
+  vector<int> values;
+  stringstream in(text);
+  string item;
+  while (getline(in, item, ',')) {
+    if (!item.empty()) {
+      values.push_back(atoi(item.c_str()));
+    }
+  }
+  return values;
+}
+
+// Column names of one row, in output order
+vector<string> columns() {
+  const char* keys[kPhaseCount + 1] = {"setup", "query", "respond", "filter", "retrieve", "total"};
+  const char* stats[3] = {"min", "median", "p99"};
+  vector<string> names;
+  for (int k = 0; k <= kPhaseCount; ++k) {
+    for (int q = 0; q < 3; ++q) {
+      names.push_back(string(keys[k]) + "_" + stats[q] + "_ms");
+    }
+  }
+  names.push_back("ots_per_s");
+  names.push_back("gb_per_s");
+  names.push_back("allocs_per_batch");
+  names.push_back("pool_misses");
+  names.push_back("refill_per_s");
+  return names;
+}
+
+void print_row(const Config& c, const PhaseBench& bench, const AllocStats& allocs, const PoolStats& pools, bool json, bool first) {
+  vector<double> values;
+  for (int k = 0; k <= kPhaseCount; ++k) {
+    PhaseSummary s = bench.summary(k);
+    values.push_back(s.min_ns / 1e6);
+    values.push_back(s.median_ns / 1e6);
+    values.push_back(s.p99_ns / 1e6);
+  }
+  // Throughput from the median total, over the n messages each OT masks
+  double total_s = bench.summary(kPhaseCount).median_ns / 1e9;
+  double ots = double(c.batch) * c.receivers;
+  values.push_back(total_s > 0 ? ots / total_s : 0);
+  values.push_back(total_s > 0 ? ots * c.n * (c.bits / 8) / total_s / 1e9 : 0);
+  values.push_back(double(allocs.max_per_batch));
+  values.push_back(double(pools.misses));
+  values.push_back(pools.refill_per_s());
+  vector<string> names = columns();
+  bool ok = bench.failures() == 0;
+  int t = c.protocol == "helix" ? 1 : c.t;
+  if (json) {
+    cout << (first ? "  {" : ",\n  {") << "\"protocol\": \"" << c.protocol << "\", \"n\": " << c.n << ", \"t\": " << t
+         << ", \"batch\": " << c.batch << ", \"bits\": " << c.bits << ", \"pads\": \"" << c.pads
+         << "\", \"query\": \"" << c.query << "\", \"mode\": \"" << c.mode
+         << "\", \"receivers\": " << c.receivers << ", \"sender\": \"" << c.sender << "\", \"context\": \"" << c.context
+         << "\", \"retrieval\": \"" << c.retrieval << "\", \"consume\": " << c.consume
+         << ", \"offline\": \"" << c.offline << "\", \"pool\": " << c.pool << ", \"idle_ms\": " << c.idle_ms << ", \"reps\": " << c.reps << ", \"warmup\": " << c.warmup;
+    for (size_t k = 0; k < values.size(); ++k) {
+      cout << ", \"" << names[k] << "\": " << values[k];
+    }
+    cout << ", \"ok\": " << (ok ? "true" : "false") << "}";
+  } else {
+    cout << c.protocol << "," << c.n << "," << t << "," << c.batch << "," << c.bits << "," << c.pads << ","
+         << c.query << "," << c.mode << "," << c.receivers << "," << c.sender << "," << c.context << "," << c.retrieval << ","
+         << c.consume << "," << c.offline << "," << c.pool << "," << c.idle_ms << "," << c.reps << ","
+         << c.warmup;
+    for (size_t k = 0; k < values.size(); ++k) {
+      cout << "," << values[k];
+    }
+    cout << "," << (ok ? 1 : 0) << "\n";
+  }
+}
+
+int main(int argc, char** argv) {
+  string protocol = "all", pads = "stored", query = "perm", mode = "batch", sender = "shared", context = "off", format = "csv";
+  string retrieval = "filter", offline = "off";
+  vector<int> ns = parse_list("256,4096"), ts = parse_list("10"), batches = parse_list("1"), bits = parse_list("128");
+  vector<int> receivers = parse_list("1");
+  int reps = 5, warmup = 1, consume = 1, pool = 4, idle_ms = 0;
+  string trace_path;
+  for (int a = 1; a + 1 < argc; a += 2) {
+    string key = argv[a], value = argv[a + 1];
+    if (key == "--protocol") protocol = value;
+    else if (key == "--n") ns = parse_list(value);
+    else if (key == "--t") ts = parse_list(value);
+    else if (key == "--batch") batches = parse_list(value);
+    else if (key == "--bits") bits = parse_list(value);
+    else if (key == "--pads") pads = value;
+    else if (key == "--query") query = value;
+    else if (key == "--mode") mode = value;
+    else if (key == "--receivers") receivers = parse_list(value);
+    else if (key == "--sender") sender = value;
+    else if (key == "--context") context = value;
+    else if (key == "--retrieval") retrieval = value;
+    else if (key == "--consume") consume = atoi(value.c_str());
+    else if (key == "--offline") offline = value;
+    else if (key == "--pool") pool = atoi(value.c_str());
+    else if (key == "--idle-ms") idle_ms = atoi(value.c_str());
+    else if (key == "--reps") reps = atoi(value.c_str());
+    else if (key == "--warmup") warmup = atoi(value.c_str());
+    else if (key == "--format") format = value;
+    else if (key == "--trace") trace_path = value;
+    else {
+      cerr << "unknown option " << key << endl;
+      return 1;
+    }
+  }
+  if (argc % 2 == 0) {
+    cerr << "missing value for " << argv[argc - 1] << endl;
+    return 1;
+  }
+  if (mode != "batch" && mode != "pipeline") {
+    cerr << "--mode must be batch or pipeline" << endl;
+    return 1;
+  }
+  if (sender != "shared" && sender != "separate") {
+    cerr << "--sender must be shared or separate" << endl;
+    return 1;
+  }
+  if (context != "on" && context != "off") {
+    cerr << "--context must be on or off" << endl;
+    return 1;
+  }
+  if (retrieval != "filter" && retrieval != "batch" && retrieval != "lazy") {
+    cerr << "--retrieval must be filter, batch or lazy" << endl;
+    return 1;
+  }
+  if (consume <= 0) {
+    consume = 1;
+  }
+  if (offline != "on" && offline != "off") {
+    cerr << "--offline must be on or off" << endl;
+    return 1;
+  }
+  if (pool <= 0) {
+    pool = 1;
+  }
+  if (idle_ms < 0) {
+    idle_ms = 0;
+  }
+  if (reps <= 0) {
+    reps = 1;
+  }
+  if (!trace_path.empty()) {
+    if (!kTraceCompiled) {
+      cerr << "--trace needs a build with -DOT_TRACE=ON" << endl;
+      return 1;
+    }
+    trace_start();
+  }
+  if (warmup < 0) {
+    warmup = 0;
+  }
+  vector<string> protocols;
+  if (protocol == "all" || protocol == "helix") protocols.push_back("helix");
+  if (protocol == "all" || protocol == "priority") protocols.push_back("priority");
+  bool json = format == "json";
+  if (json) {
+    cout << "[\n";
+  } else {
+    cout << "protocol,n,t,batch,bits,pads,query,mode,receivers,sender,context,retrieval,consume,offline,pool,idle_ms,reps,warmup";
+    vector<string> names = columns();
+    for (size_t k = 0; k < names.size(); ++k) {
+      cout << "," << names[k];
+    }
+    cout << ",ok\n";
+  }
+  bool first = true, all_ok = true;
+  for (size_t pi = 0; pi < protocols.size(); ++pi) {
+    // t only matters for Priority OT
+    vector<int> sweep_t = protocols[pi] == "helix" ? vector<int>(1, 1) : ts;
+    for (size_t a = 0; a < ns.size(); ++a) {
+      for (size_t b = 0; b < sweep_t.size(); ++b) {
+        for (size_t c = 0; c < batches.size(); ++c) {
+          for (size_t d = 0; d < bits.size(); ++d) {
+            for (size_t e = 0; e < receivers.size(); ++e) {
+              Config config = {protocols[pi], ns[a], sweep_t[b], batches[c], unsigned(bits[d]), pads,
+                               protocols[pi] == "helix" ? "tbcs" : query, mode, max(1, receivers[e]), sender, context,
+                               protocols[pi] == "helix" ? "filter" : retrieval, consume, offline, pool, idle_ms, reps, warmup};
+              PhaseBench bench(warmup, reps);
+              AllocStats allocs = {0, 0};
+              PoolStats pools = {0, 0, 0};
+              if (!run(config, bench, allocs, pools)) {
+                continue;
+              }
+              all_ok = all_ok && bench.failures() == 0;
+              print_row(config, bench, allocs, pools, json, first);
+              first = false;
+              cout.flush();
+              if (!trace_path.empty()) {
+                cerr << "\n " << config.protocol << " n=" << config.n << " batch=" << config.batch
+                     << " bits=" << config.bits;
+                trace_report(cerr, size_t(reps));
+                trace_write_json(trace_path);
+              }
+            }
+          }
+        }
+      }
+    }
+  }
+  if (json) {
+    cout << "\n]" << endl;
+  }
+  return all_ok ? 0 : 1;
+}
@@ -0,0 +1,482 @@
+// Scaling benchmark suite. Runs ot_bench over a parameter grid of both protocols, one process
+// per point so that peak RSS belongs to that point alone, and records the median time of each
+// phase and the peak RSS in a versioned baseline file. Given an earlier baseline it flags every
+// phase that got slower (and every point that grew in memory) by more than a threshold. It
+// also prints, along each axis of the grid, how fast each phase grows relative to the axis and
+// marks the points where a phase grows faster than the axis does, i.e. where it stops scaling.
+//
+//   cmake -S . -B build && cmake --build build --target ot_bench ot_suite
+//   ./build/ot_suite --grid quick --save baseline.csv
+//   ./build/ot_suite --grid quick --baseline baseline.csv --threshold 10
+//
+// Options:
+//   --grid quick|full        quick: a few points per axis, a couple of minutes; full: n from 2
+//                            to 2^22, t from 1 to 64, batch from 1 to 10^4, bits 128/256/1024;
+//                            default quick
+//   --protocol helix|priority|all   default all
+//   --bench PATH             the ot_bench binary, default the one next to ot_suite
+//   --save FILE              write this run as a baseline
+//   --baseline FILE          compare this run against a baseline
+//   --threshold PCT          slowdown or RSS growth that counts as a regression, default 10
+//   --min-ms MS              phases under this in both runs are noise and not compared, and
+//                            not used for scaling exponents; default 0.05
+//   --max-gb GB              skip points whose pads and responses would need more, default
+//                            half of physical memory
+//   --reps N                 timed repetitions per point, default 5
+//   --warmup N               untimed repetitions per point, default 1
+//
+// The grid is one sweep per axis around a base point (the other three parameters fixed), not
+// the full cross product, which would not fit in memory at the large corners.
+//
+// Exit status: 0 if every point ran and was correct with no regression, 1 if a point failed or
+// could not run, 2 if a regression was flagged.
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+using namespace std;
+
+const char* kBaselineVersion = "# ot_suite baseline v1";
+
+// Phases in ot_bench column order, then the total
+const int kSuitePhases = 6;
+const char* kSuitePhaseNames[kSuitePhases] = {"setup", "query", "respond", "filter", "retrieve", "total"};
+
+struct Point {
+  string protocol;
+  int n;
+  int t;
+  int batch;
+  int bits;
+
+  string key() const {
+    ostringstream out;
+    out << protocol << "," << n << "," << t << "," << batch << "," << bits;
+    return out.str();
+  }
+};
+
+struct Result {
+  double ms[kSuitePhases];  // median per phase
+  long rss_kb;
+  bool ok;
+};
+
+// One sweep: points along one axis with the others at the base point
+struct Sweep {
+  string protocol;
+  string axis;  // "n", "t", "batch" or "bits"
+  vector<Point> points;
+};
+
+int axis_value(const Point& p, const string& axis) {
+  if (axis == "n") return p.n;
+  if (axis == "t") return p.t;
+  if (axis == "batch") return p.batch;
+  return p.bits;
+}
+
+vector<Sweep> make_grid(const string& grid, const string& protocol) {
+  const bool full = grid == "full";
+  vector<int> ns, ts, batches, bits;
+  int base_n = full ? 65536 : 4096, base_t = 8, base_batch = 16, base_bits = 128;
+  if (full) {
+    for (int e = 1; e <= 22; ++e) {
+      ns.push_back(1 << e);
+    }
+    ts = {1, 2, 4, 8, 16, 32, 64};
+    batches = {1, 10, 100, 1000, 10000};
+  } else {
+    ns = {16, 256, 4096, 65536};
+    ts = {1, 8, 64};
+    batches = {1, 16, 256};
+  }
+  bits = {128, 256, 1024};
+  vector<string> protocols;
+  if (protocol == "all" || protocol == "helix") protocols.push_back("helix");
+  if (protocol == "all" || protocol == "priority") protocols.push_back("priority");
+  vector<Sweep> sweeps;
+  for (size_t k = 0; k < protocols.size(); ++k) {
+    const string& name = protocols[k];
+    const bool helix = name == "helix";
+    // t only matters for Priority OT, and there it cannot exceed n
+    Point base = {name, base_n, helix ? 1 : base_t, base_batch, base_bits};
+    Sweep by_n = {name, "n", {}};
+    for (size_t i = 0; i < ns.size(); ++i) {
+      Point p = base;
+      p.n = ns[i];
+      p.t = helix ? 1 : min(base_t, p.n);
+      by_n.points.push_back(p);
+    }
+    sweeps.push_back(by_n);
+    if (!helix) {
+      Sweep by_t = {name, "t", {}};
+      for (size_t i = 0; i < ts.size(); ++i) {
+        Point p = base;
+        p.t = ts[i];
+        by_t.points.push_back(p);
+      }
+      sweeps.push_back(by_t);
+    }
+    Sweep by_batch = {name, "batch", {}};
+    for (size_t i = 0; i < batches.size(); ++i) {
+      // at n = 4096, so that 10^4 invocations fit in memory
+      Point p = base;
+      p.n = 4096;
+      p.batch = batches[i];
+      by_batch.points.push_back(p);
+    }
+    sweeps.push_back(by_batch);
+    Sweep by_bits = {name, "bits", {}};
+    for (size_t i = 0; i < bits.size(); ++i) {
+      Point p = base;
+      p.bits = bits[i];
+      by_bits.points.push_back(p);
+    }
+    sweeps.push_back(by_bits);
+  }
+  return sweeps;
+}
+
+// Bytes a point holds at its peak: m, the pads and the response, and for Priority OT the
+// query permutations and their inverses
+double point_bytes(const Point& p) {
+  double message = p.bits / 8.0;
+  double bytes = p.n * message + 2.0 * p.batch * p.n * message;
+  if (p.protocol == "priority") {
+    bytes += 2.0 * p.batch * p.n * sizeof(int);
+  }
+  return bytes;
+}
+
+vector<string> split(const string& line, char sep) {
+  vector<string> fields;
+  stringstream in(line);
+  string field;
+  while (getline(in, field, sep)) {
+    fields.push_back(field);
+  }
+  return fields;
+}
+
+// Runs ot_bench for one point in a child process and reads its CSV row; the child's peak
+// RSS comes from wait4. Returns false if it could not run or printed no row.
+bool run_point(const string& bench, const Point& p, int reps, int warmup, Result& result) {
+  vector<string> args = {bench, "--protocol", p.protocol, "--n", to_string(p.n), "--t", to_string(p.t),
+                         "--batch", to_string(p.batch), "--bits", to_string(p.bits),
+                         "--reps", to_string(reps), "--warmup", to_string(warmup), "--format", "csv"};
+  int fds[2];
+  if (pipe(fds) != 0) {
+    perror("pipe");
+    return false;
+  }
+  pid_t pid = fork();
+  if (pid < 0) {
+    perror("fork");
+    return false;
+  }
+  if (pid == 0) {
+    dup2(fds[1], STDOUT_FILENO);
+    close(fds[0]);
+    close(fds[1]);
+    vector<char*> argv;
+    for (size_t k = 0; k < args.size(); ++k) {
+      argv.push_back(const_cast<char*>(args[k].c_str()));
+    }
+    argv.push_back(nullptr);
+    execv(bench.c_str(), argv.data());
+    perror(bench.c_str());
+    _exit(127);
+  }
+  close(fds[1]);
+  string output;
+  char buffer[4096];
+  ssize_t got;
+  while ((got = read(fds[0], buffer, sizeof(buffer))) > 0) {
+    output.append(buffer, size_t(got));
+  }
+  close(fds[0]);
+  int status = 0;
+  struct rusage usage;
+  if (wait4(pid, &status, 0, &usage) < 0) {
+    perror("wait4");
+    return false;
+  }
+  result.rss_kb = usage.ru_maxrss;  // kilobytes on Linux
+  vector<string> lines = split(output, '\n');
+  if (lines.size() < 2) {
+    return false;
+  }
+  vector<string> names = split(lines[0], ','), values = split(lines[1], ',');
+  map<string, string> row;
+  for (size_t k = 0; k < names.size() && k < values.size(); ++k) {
+    row[names[k]] = values[k];
+  }
+  for (int q = 0; q < kSuitePhases; ++q) {
+    string column = string(kSuitePhaseNames[q]) + "_median_ms";
+    if (row.count(column) == 0) {
+      cerr << "ot_bench printed no " << column << " column" << endl;
+      return false;
+    }
+    result.ms[q] = atof(row[column].c_str());
+  }
+  result.ok = row["ok"] == "1" && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+  return true;
+}
+
+string header() {
+  string line = "protocol,n,t,batch,bits";
+  for (int q = 0; q < kSuitePhases; ++q) {
+    line += string(",") + kSuitePhaseNames[q] + "_ms";
+  }
+  return line + ",peak_rss_kb,ok";
+}
+
+bool save_baseline(const string& path, const string& grid, int reps, const vector<Point>& order, const map<string, Result>& results) {
+  ofstream out(path.c_str());
+  if (!out) {
+    cerr << "cannot write " << path << endl;
+    return false;
+  }
+  char host[256] = "unknown";
+  gethostname(host, sizeof(host) - 1);
+  char date[32];
+  time_t now = time(nullptr);
+  strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%SZ", gmtime(&now));
+  out << kBaselineVersion << "\n";
+  out << "# host=" << host << " threads=" << thread::hardware_concurrency() << " grid=" << grid << " reps=" << reps
+      << " date=" << date << "\n";
+  out << header() << "\n";
+  for (size_t k = 0; k < order.size(); ++k) {
+    const Result& r = results.at(order[k].key());
+    out << order[k].key();
+    for (int q = 0; q < kSuitePhases; ++q) {
+      out << "," << r.ms[q];
+    }
+    out << "," << r.rss_kb << "," << (r.ok ? 1 : 0) << "\n";
+  }
+  return true;
+}
+
+bool load_baseline(const string& path, map<string, Result>& results) {
+  ifstream in(path.c_str());
+  string line;
+  if (!in || !getline(in, line)) {
+    cerr << "cannot read " << path << endl;
+    return false;
+  }
+  if (line != kBaselineVersion) {
+    cerr << path << " is not a baseline this ot_suite reads (expected \"" << kBaselineVersion << "\")" << endl;
+    return false;
+  }
+  while (getline(in, line)) {
+    if (line.empty() || line[0] == '#' || line.compare(0, 9, "protocol,") == 0) {
+      continue;
+    }
+    vector<string> fields = split(line, ',');
+    if (fields.size() != size_t(5 + kSuitePhases + 2)) {
+      cerr << path << ": malformed row: " << line << endl;
+      return false;
+    }
+    Result r;
+    for (int q = 0; q < kSuitePhases; ++q) {
+      r.ms[q] = atof(fields[5 + q].c_str());
+    }
+    r.rss_kb = atol(fields[5 + kSuitePhases].c_str());
+    r.ok = fields[6 + kSuitePhases] == "1";
+    results[fields[0] + "," + fields[1] + "," + fields[2] + "," + fields[3] + "," + fields[4]] = r;
+  }
+  return true;
+}
+
+// Growth of a phase between two points of a sweep relative to the axis: 1 is linear in the
+// axis, 0 flat. Phases grow at most linearly in n, t, batch and bits, so an exponent well
+// above 1 is where a phase stops scaling (a cache level spills, threads run out, ...).
+const double kSuperlinear = 1.25;
+
+void print_sweep(const Sweep& sweep, const map<string, Result>& results, double min_ms) {
+  const Point& first = sweep.points[0];
+  cout << "\n" << sweep.protocol << " along " << sweep.axis << " (";
+  bool comma = false;
+  const char* axes[4] = {"n", "t", "batch", "bits"};
+  for (int a = 0; a < 4; ++a) {
+    if (sweep.axis == axes[a] || (sweep.protocol == "helix" && string(axes[a]) == "t")) {
+      continue;
+    }
+    cout << (comma ? ", " : "") << axes[a] << "=" << axis_value(first, axes[a]);
+    comma = true;
+  }
+  cout << "), median ms with the growth exponent since the previous point; ! = grows faster than " << sweep.axis
+       << "\n";
+  cout << setw(9) << sweep.axis;
+  for (int q = 0; q < kSuitePhases; ++q) {
+    cout << setw(18) << kSuitePhaseNames[q];
+  }
+  cout << setw(12) << "rss_mb" << "\n";
+  const Result* previous = nullptr;
+  int previous_x = 0;
+  for (size_t k = 0; k < sweep.points.size(); ++k) {
+    map<string, Result>::const_iterator it = results.find(sweep.points[k].key());
+    if (it == results.end()) {
+      continue;
+    }
+    const Result& r = it->second;
+    const int x = axis_value(sweep.points[k], sweep.axis);
+    cout << setw(9) << x;
+    for (int q = 0; q < kSuitePhases; ++q) {
+      ostringstream cell;
+      cell << fixed << setprecision(r.ms[q] < 10 ? 3 : 1) << r.ms[q];
+      if (previous != nullptr && x != previous_x && r.ms[q] >= min_ms && previous->ms[q] >= min_ms) {
+        double exponent = log(r.ms[q] / previous->ms[q]) / log(double(x) / previous_x);
+        cell << " (" << setprecision(2) << exponent << (exponent > kSuperlinear ? "!" : "") << ")";
+      }
+      cout << setw(18) << cell.str();
+    }
+    ostringstream rss;
+    rss << fixed << setprecision(1) << r.rss_kb / 1024.0;
+    cout << setw(12) << rss.str() << (r.ok ? "" : "  FAILED") << "\n";
+    previous = &r;
+    previous_x = x;
+  }
+}
+
+// Prints every phase (and the peak RSS) of current that is more than threshold slower (larger)
+// than in baseline; returns the number flagged
+int compare(const vector<Point>& order, const map<string, Result>& current, const map<string, Result>& baseline,
+            double threshold, double min_ms) {
+  int flagged = 0, compared = 0;
+  cout << "\nregressions above " << threshold * 100 << "% against the baseline:\n";
+  for (size_t k = 0; k < order.size(); ++k) {
+    const string key = order[k].key();
+    map<string, Result>::const_iterator now = current.find(key), then = baseline.find(key);
+    if (now == current.end() || then == baseline.end()) {
+      continue;
+    }
+    ++compared;
+    for (int q = 0; q <= kSuitePhases; ++q) {
+      // q == kSuitePhases is the peak RSS, compared above 1 MB of growth
+      const bool rss = q == kSuitePhases;
+      double a = rss ? then->second.rss_kb : then->second.ms[q];
+      double b = rss ? now->second.rss_kb : now->second.ms[q];
+      bool noise = rss ? b - a < 1024 : max(a, b) < min_ms;
+      if (noise || a <= 0 || b <= a * (1 + threshold)) {
+        continue;
+      }
+      ++flagged;
+      ostringstream growth;
+      growth << fixed << setprecision(1) << (b / a - 1) * 100;
+      cout << "  REGRESSION " << key << " " << (rss ? "peak_rss_kb" : kSuitePhaseNames[q]) << ": " << a << " -> " << b
+           << " (+" << growth.str() << "%)\n";
+    }
+  }
+  if (flagged == 0) {
+    cout << "  none (" << compared << " points compared)\n";
+  }
+  return flagged;
+}
+
+string default_bench(const char* argv0) {
+  string self = argv0;
+  size_t slash = self.rfind('/');
+  return (slash == string::npos ? string("./") : self.substr(0, slash + 1)) + "ot_bench";
+}
+
+int main(int argc, char** argv) {
+  string grid = "quick", protocol = "all", bench = default_bench(argv[0]), save, baseline_path;
+  double threshold = 10, min_ms = 0.05;
+  double max_gb = double(sysconf(_SC_PHYS_PAGES)) * sysconf(_SC_PAGE_SIZE) / 2 / 1e9;
+  int reps = 5, warmup = 1;
+  for (int a = 1; a + 1 < argc; a += 2) {
+    string key = argv[a], value = argv[a + 1];
+    if (key == "--grid") grid = value;
+    else if (key == "--protocol") protocol = value;
+    else if (key == "--bench") bench = value;
+    else if (key == "--save") save = value;
+    else if (key == "--baseline") baseline_path = value;
+    else if (key == "--threshold") threshold = atof(value.c_str());
+    else if (key == "--min-ms") min_ms = atof(value.c_str());
+    else if (key == "--max-gb") max_gb = atof(value.c_str());
+    else if (key == "--reps") reps = atoi(value.c_str());
+    else if (key == "--warmup") warmup = atoi(value.c_str());
+    else {
+      cerr << "unknown option " << key << endl;
+      return 1;
+    }
+  }
+  if (argc % 2 == 0) {
+    cerr << "missing value for " << argv[argc - 1] << endl;
+    return 1;
+  }
+  if (grid != "quick" && grid != "full") {
+    cerr << "--grid must be quick or full" << endl;
+    return 1;
+  }
+  if (access(bench.c_str(), X_OK) != 0) {
+    cerr << "no ot_bench at " << bench << " (build the ot_bench target or pass --bench)" << endl;
+    return 1;
+  }
+  map<string, Result> baseline;
+  if (!baseline_path.empty() && !load_baseline(baseline_path, baseline)) {
+    return 1;
+  }
+  vector<Sweep> sweeps = make_grid(grid, protocol);
+  // Points shared by several sweeps (the base point) run once
+  vector<Point> order;
+  map<string, Result> results;
+  bool all_ok = true;
+  for (size_t s = 0; s < sweeps.size(); ++s) {
+    for (size_t k = 0; k < sweeps[s].points.size(); ++k) {
+      const Point& p = sweeps[s].points[k];
+      if (results.count(p.key()) != 0) {
+        continue;
+      }
+      if (point_bytes(p) > max_gb * 1e9) {
+        cerr << "skipping " << p.key() << ": needs about " << point_bytes(p) / 1e9 << " GB (--max-gb " << max_gb << ")"
+             << endl;
+        continue;
+      }
+      cerr << "running " << p.key() << endl;
+      Result r;
+      if (!run_point(bench, p, reps, warmup, r)) {
+        cerr << "  " << p.key() << " did not run" << endl;
+        all_ok = false;
+        continue;
+      }
+      all_ok = all_ok && r.ok;
+      results[p.key()] = r;
+      order.push_back(p);
+    }
+  }
+  cout << "ot_suite: " << order.size() << " points, grid " << grid << ", " << reps << " reps each\n";
+  for (size_t s = 0; s < sweeps.size(); ++s) {
+    print_sweep(sweeps[s], results, min_ms);
+  }
+  int flagged = 0;
+  if (!baseline_path.empty()) {
+    flagged = compare(order, results, baseline, threshold / 100, min_ms);
+  }
+  if (!save.empty()) {
+    if (!save_baseline(save, grid, reps, order, results)) {
+      return 1;
+    }
+    cout << "\nbaseline written to " << save << "\n";
+  }
+  if (!all_ok) {
+    return 1;
+  }
+  return flagged > 0 ? 2 : 0;
+}
@@ -0,0 +1,82 @@
+// Microbenchmark for the Phase 3 / Phase 5 masking XOR: the original per-element
+// mpz_class XOR against every batch XOR kernel this CPU supports.
+//
+//   g++ -std=c++11 -O2 xor_bench.cpp -o xor_bench -lgmpxx -lgmp
+//   ./xor_bench [n] [repetitions]
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <chrono>
+#include <cstdlib>
+#include <gmpxx.h>
+#include "../common/block.h"
+#include "../common/xor_kernel.h"
+using namespace std;
+
+const unsigned bit_size = 128;
+
+template <typename F>
+double best_seconds(int repetitions, F run) {
+  double best = 1e30;
+  for (int k = 0; k < repetitions; ++k) {
+    auto start = chrono::steady_clock::now();
+    run();
+    double s = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    if (s < best) {
+      best = s;
+    }
+  }
+  return best;
+}
+
+void report(const char* name, double seconds, size_t n) {
+  // bytes touched: two inputs read, one output written
+  double bytes = 3.0 * n * (bit_size / 8);
+  cout << setw(8) << name << setw(14) << fixed << setprecision(3) << seconds * 1e6 << " us"
+       << setw(12) << setprecision(2) << seconds * 1e9 / n << " ns/msg"
+       << setw(12) << bytes / seconds / 1e9 << " GB/s" << endl;
+}
+
+int main(int argc, char** argv) {
+  size_t n = argc > 1 ? strtoul(argv[1], nullptr, 10) : 65536;
+  int repetitions = argc > 2 ? atoi(argv[2]) : 50;
+
+  gmp_randclass rng(gmp_randinit_default);
+  rng.seed(1);
+  vector<mpz_class> m(n), r(n), x(n);
+  BlockVector<bit_size> bm(n), br(n), bx(n), expected(n);
+  for (size_t i = 0; i < n; ++i) {
+    m[i] = rng.get_z_bits(bit_size);
+    r[i] = rng.get_z_bits(bit_size);
+    bm[i].assign(m[i]);
+    br[i].assign(r[i]);
+  }
+
+  cout << "n = " << n << ", bit_size = " << bit_size << ", best of " << repetitions << endl;
+  report("gmp", best_seconds(repetitions, [&] {
+    for (size_t i = 0; i < n; ++i) {
+      x[i] = m[i] ^ r[i];
+    }
+  }), n);
+  for (size_t i = 0; i < n; ++i) {
+    expected[i].assign(x[i]);
+  }
+
+  for (int isa = kXorScalar; isa < kXorIsaCount; ++isa) {
+    XorWordsFn kernel = xor_words_kernel(static_cast<XorIsa>(isa));
+    if (kernel == nullptr) {
+      cout << setw(8) << xor_isa_name(static_cast<XorIsa>(isa)) << "   (not supported on this CPU)" << endl;
+      continue;
+    }
+    size_t words = n * Block<bit_size>::kWords;
+    double s = best_seconds(repetitions, [&] { kernel(bx[0].w, bm[0].w, br[0].w, words); });
+    report(xor_isa_name(static_cast<XorIsa>(isa)), s, n);
+    if (bx != expected) {
+      cerr << "\n ** Error: " << xor_isa_name(static_cast<XorIsa>(isa)) << " output differs from the GMP XOR" << endl;
+      return 1;
+    }
+  }
+  cout << "dispatch selects: " << xor_isa_name(best_xor_isa()) << endl;
+  return 0;
+}
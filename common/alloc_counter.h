@@ -0,0 +1,20 @@
+#ifndef OT_COMMON_ALLOC_COUNTER_H
+#define OT_COMMON_ALLOC_COUNTER_H
+
+#include <atomic>
+#include <cstdint>
+
+// Heap allocation counter, the hook for checking that steady-state batches allocate nothing.
+// Aligned buffers (AlignedAllocator) always count themselves. A program that also links
+// bench/alloc_hooks.cpp counts every operator new and every GMP limb allocation.
+inline std::atomic<uint64_t>& heap_allocation_counter() {
+  static std::atomic<uint64_t> count(0);
+  return count;
+}
+
+inline void count_heap_allocation() { heap_allocation_counter().fetch_add(1, std::memory_order_relaxed); }
+
+// Allocations so far; the difference of two reads is what the code in between allocated
+inline uint64_t heap_allocations() { return heap_allocation_counter().load(std::memory_order_relaxed); }
+
+#endif
@@ -0,0 +1,91 @@
+#ifndef OT_COMMON_ARENA_H
+#define OT_COMMON_ARENA_H
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <type_traits>
+#include <vector>
+#include "block.h"
+#include "flat_buffer.h"
+#include "lazy_pads.h"
+
+// Bump arena for the buffers of one batch. The buffer is reserved once, from the sizes the
+// batch will ask for; take() carves 64-byte aligned regions from it in order, and reset()
+// hands the same memory out again for the next batch, so repeated batches of one
+// configuration never touch the heap. Regions are uninitialized and hold trivially copyable
+// elements only.
+class Arena {
+public:
+  static const size_t kAlign = 64;
+
+  Arena() : used_(0) {}
+  explicit Arena(size_t bytes) : used_(0) { reserve(bytes); }
+
+  // Bytes that take<T>(count) uses up, alignment padding included
+  template <typename T>
+  static size_t bytes_for(size_t count) {
+    return (count * sizeof(T) + kAlign - 1) / kAlign * kAlign;
+  }
+
+  // Grows the buffer to at least bytes; regions handed out before are lost
+  void reserve(size_t bytes) {
+    if (bytes > buffer_.size()) {
+      buffer_ = std::vector<uint8_t, AlignedAllocator<uint8_t, kAlign> >(bytes);
+      used_ = 0;
+    }
+  }
+
+  void reset() { used_ = 0; }
+
+  size_t capacity() const { return buffer_.size(); }
+  size_t used() const { return used_; }
+
+  // count uninitialized elements; throws bad_alloc past the reserved capacity, since growing
+  // would move the regions already handed out
+  template <typename T>
+  T* take(size_t count) {
+    static_assert(std::is_trivially_copyable<T>::value, "arena regions are never constructed or destroyed");
+    static_assert(kAlign % alignof(T) == 0, "arena regions are 64-byte aligned");
+    const size_t bytes = bytes_for<T>(count);
+    if (bytes > buffer_.size() - used_) {
+      throw std::bad_alloc();
+    }
+    T* region = reinterpret_cast<T*>(buffer_.data() + used_);
+    used_ += bytes;
+    return region;
+  }
+
+  template <typename T>
+  MatrixView<T> take_matrix(size_t rows, size_t cols) {
+    return MatrixView<T>(take<T>(rows * cols), rows, cols);
+  }
+
+private:
+  Arena(const Arena&);
+  Arena& operator=(const Arena&);
+
+  std::vector<uint8_t, AlignedAllocator<uint8_t, kAlign> > buffer_;
+  size_t used_;
+};
+
+// A batch's pads inside an arena: stored pads are a number_of_OT x n region of it,
+// seed-compressed pads keep only their seed and take no arena space
+template <typename Pads>
+struct ArenaPads;
+
+template <unsigned Bits>
+struct ArenaPads<BlockMatrix<Bits> > {
+  typedef MatrixView<Block<Bits> > type;
+  static size_t bytes(size_t rows, size_t cols) { return Arena::bytes_for<Block<Bits> >(rows * cols); }
+  static type take(Arena& arena, size_t rows, size_t cols) { return arena.take_matrix<Block<Bits> >(rows, cols); }
+};
+
+template <unsigned Bits>
+struct ArenaPads<LazyPads<Bits> > {
+  typedef LazyPads<Bits> type;
+  static size_t bytes(size_t, size_t) { return 0; }
+  static type take(Arena&, size_t, size_t) { return type(); }
+};
+
+#endif
@@ -0,0 +1,133 @@
+#ifndef OT_COMMON_BATCH_H
+#define OT_COMMON_BATCH_H
+
+#include <cstddef>
+#include <algorithm>
+#include <cstdint>
+#include <random>
+#include "cache_info.h"
+#include "thread_pool.h"
+
+// Batch execution of number_of_OT independent invocations, each touching n messages.
+// Randomness is drawn from streams keyed by (seed, invocation) rather than by thread, so
+// the output for a fixed seed does not depend on how work was split.
+
+// Column granularity: rows are only ever cut at multiples of this
+const size_t kBatchChunk = 4096;
+
+// Runs body(j, lo, hi) over every invocation j and column range [lo, hi) of [0, n).
+// Whole invocations are spread across threads when there are enough of them; otherwise
+// each invocation is cut into kBatchChunk-aligned column ranges.
+template <typename F>
+void batch_for(ThreadPool& pool, size_t number_of_OT, size_t n, const F& body) {
+  if (number_of_OT >= pool.size() || n <= kBatchChunk) {
+    pool.parallel_for(0, number_of_OT, 1, [&](size_t lo, size_t hi) {
+      for (size_t j = lo; j < hi; ++j) {
+        body(j, size_t(0), n);
+      }
+    });
+    return;
+  }
+  size_t chunks = (n + kBatchChunk - 1) / kBatchChunk;
+  pool.parallel_for(0, number_of_OT * chunks, 1, [&](size_t lo, size_t hi) {
+    for (size_t c = lo; c < hi; ++c) {
+      size_t j = c / chunks;
+      size_t begin = (c % chunks) * kBatchChunk;
+      body(j, begin, std::min(n, begin + kBatchChunk));
+    }
+  });
+}
+
+// Bytes of m handled per step of a shared scan, from the measured cache sizes: one chunk
+// stays in L2 while every invocation reads it (half of L2, leaving the rest to the pad and
+// output streams), and the chunks that `threads` threads scan side by side fit in L3 together
+inline size_t scan_bytes(size_t threads) {
+  const CacheSizes& cache = cache_sizes();
+  size_t bytes = cache.l2 / 2;
+  if (cache.l3 > 0) {
+    bytes = std::min(bytes, cache.l3 / (2 * std::max<size_t>(1, threads)));
+  }
+  return std::max<size_t>(bytes, 16 * 1024);
+}
+
+// Messages per shared-scan chunk: a power of two, so that TBCS maps whole chunks onto whole
+// chunks, and no larger than n
+inline size_t scan_chunk(size_t n, size_t message_bytes, size_t threads = ThreadPool::global().size()) {
+  const size_t bytes = scan_bytes(threads);
+  size_t chunk = 1;
+  while (chunk * 2 <= n && chunk * 2 * message_bytes <= bytes) {
+    chunk *= 2;
+  }
+  return chunk;
+}
+
+// Shared scan over m: runs body(lo, hi, j_lo, j_hi) so that message chunk [lo, hi) is applied
+// to invocations [j_lo, j_hi) by one task, i.e. m is read once rather than once per
+// invocation. When there are fewer chunks than threads the invocations are split as well.
+template <typename F>
+void scan_for(ThreadPool& pool, size_t number_of_OT, size_t n, size_t chunk, const F& body) {
+  if (number_of_OT == 0 || n == 0) {
+    return;
+  }
+  size_t chunks = (n + chunk - 1) / chunk;
+  size_t groups = std::min(number_of_OT, std::max<size_t>(1, (pool.size() + chunks - 1) / chunks));
+  size_t per_group = (number_of_OT + groups - 1) / groups;
+  groups = (number_of_OT + per_group - 1) / per_group;
+  pool.parallel_for(0, chunks * groups, 1, [&](size_t lo, size_t hi) {
+    for (size_t task = lo; task < hi; ++task) {
+      size_t c = task / groups;
+      size_t g = task % groups;
+      body(c * chunk, std::min(n, (c + 1) * chunk), g * per_group, std::min(number_of_OT, (g + 1) * per_group));
+    }
+  });
+}
+
+// Invocation j of the query-th queued query, when the batches of several receivers are scanned
+// as one: the scan runs over a flat list of these
+struct QueryInvocation {
+  uint32_t query;
+  uint32_t j;
+};
+
+// std::seed_seq over four fixed words, without its heap-allocated copy of them: generate() is
+// the seed_seq algorithm of [rand.util.seedseq], so engines come out seeded identically
+struct StreamSeedSeq {
+  typedef uint32_t result_type;
+  uint32_t v[4];
+
+  template <typename It>
+  void generate(It begin, It end) const {
+    const size_t n = size_t(end - begin), s = 4;
+    if (n == 0) {
+      return;
+    }
+    std::fill(begin, end, result_type(0x8b8b8b8b));
+    const size_t t = n >= 623 ? 11 : n >= 68 ? 7 : n >= 39 ? 5 : n >= 7 ? 3 : (n - 1) / 2;
+    const size_t p = (n - t) / 2, q = p + t, m = std::max(s + 1, n);
+    for (size_t k = 0; k < m; ++k) {
+      uint32_t r1 = 1664525u * mix(uint32_t(begin[k % n] ^ begin[(k + p) % n] ^ begin[(k + n - 1) % n]));
+      uint32_t r2 = r1 + uint32_t(k == 0 ? s : k <= s ? k % n + v[k - 1] : k % n);
+      begin[(k + p) % n] = uint32_t(begin[(k + p) % n] + r1);
+      begin[(k + q) % n] = uint32_t(begin[(k + q) % n] + r2);
+      begin[k % n] = r2;
+    }
+    for (size_t k = m; k < m + n; ++k) {
+      uint32_t r3 = 1566083941u * mix(uint32_t(begin[k % n] + begin[(k + p) % n] + begin[(k + n - 1) % n]));
+      uint32_t r4 = r3 - uint32_t(k % n);
+      begin[(k + p) % n] = uint32_t(begin[(k + p) % n] ^ r3);
+      begin[(k + q) % n] = uint32_t(begin[(k + q) % n] ^ r4);
+      begin[k % n] = r4;
+    }
+  }
+
+private:
+  static uint32_t mix(uint32_t x) { return x ^ (x >> 27); }
+};
+
+// Seeds rng for stream invocation of seed
+inline void seed_stream(std::mt19937& rng, unsigned long seed, uint64_t invocation) {
+  const StreamSeedSeq key = {{uint32_t(seed), uint32_t(uint64_t(seed) >> 32), uint32_t(invocation), uint32_t(invocation >> 32)}};
+  rng.seed(key);
+}
+
+#endif
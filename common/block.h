@@ -0,0 +1,107 @@
+#ifndef OT_COMMON_BLOCK_H
+#define OT_COMMON_BLOCK_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <gmpxx.h>
+#include "flat_buffer.h"
+
+// Natural alignment of a Bits-wide block: widths that fill whole vector registers get
+// register alignment, everything else stays packed on 64-bit limbs
+template <unsigned Bits>
+struct BlockAlign {
+  static const size_t value = (Bits % 512 == 0) ? 64 : (Bits % 256 == 0) ? 32 : (Bits % 128 == 0) ? 16 : 8;
+};
+
+// Fixed-width message of Bits bits held as 64-bit limbs, least significant limb first.
+// Replaces mpz_class on the data path when bit_size is known at compile time.
+template <unsigned Bits>
+struct alignas(BlockAlign<Bits>::value) Block {
+  static const unsigned kBits = Bits;
+  static const size_t kWords = (Bits + 63) / 64;
+
+  uint64_t w[kWords];
+
+  Block() { memset(w, 0, sizeof(w)); }
+  explicit Block(const mpz_class& v) { assign(v); }
+
+  // Copies v into the limbs; bits above Bits are dropped
+  void assign(const mpz_class& v) {
+    memset(w, 0, sizeof(w));
+    if (mpz_sizeinbase(v.get_mpz_t(), 2) <= Bits) {
+      mpz_export(w, nullptr, -1, sizeof(uint64_t), 0, 0, v.get_mpz_t());
+    } else {
+      mpz_class low;
+      mpz_fdiv_r_2exp(low.get_mpz_t(), v.get_mpz_t(), Bits);
+      mpz_export(w, nullptr, -1, sizeof(uint64_t), 0, 0, low.get_mpz_t());
+    }
+  }
+
+  mpz_class to_mpz() const {
+    mpz_class v;
+    mpz_import(v.get_mpz_t(), kWords, -1, sizeof(uint64_t), 0, 0, w);
+    return v;
+  }
+
+  Block& operator^=(const Block& o) {
+    for (size_t k = 0; k < kWords; ++k) {
+      w[k] ^= o.w[k];
+    }
+    return *this;
+  }
+  friend Block operator^(Block a, const Block& b) { return a ^= b; }
+  friend bool operator==(const Block& a, const Block& b) { return memcmp(a.w, b.w, sizeof(a.w)) == 0; }
+  friend bool operator!=(const Block& a, const Block& b) { return !(a == b); }
+};
+
+// Count blocks of stack staging left uninitialized, for buffers that are always written
+// before they are read; a Block array would zero all of it on every call
+template <unsigned Bits, size_t Count>
+class BlockStage {
+public:
+  static const size_t kCount = Count;
+
+  Block<Bits>* data() { return reinterpret_cast<Block<Bits>*>(bytes_); }
+  size_t size() const { return Count; }
+
+private:
+  alignas(Block<Bits>) unsigned char bytes_[Count * sizeof(Block<Bits>)];
+};
+
+template <unsigned Bits>
+using BlockVector = std::vector<Block<Bits>, AlignedAllocator<Block<Bits> > >;
+template <unsigned Bits>
+using BlockMatrix = FlatMatrix<Block<Bits> >;
+
+// Fills count blocks with uniform Bits-bit values drawn from rng. A single scratch mpz is
+// reused, so unlike get_z_bits per element there is no allocation per block.
+template <unsigned Bits>
+void generate_random_blocks(gmp_randclass& rng, Block<Bits>* out, size_t count) {
+  mpz_class tmp;
+  for (size_t i = 0; i < count; ++i) {
+    tmp = rng.get_z_bits(Bits);
+    out[i].assign(tmp);
+  }
+}
+
+// Message storage used by the phase functions. BlockMessages keeps every message and pad
+// in flat Block buffers; MpzMessages is the original arbitrary-width mpz_class path.
+// pad_type holds Setup's output (see LazyBlockMessages for pads kept as a seed).
+template <unsigned Bits>
+struct BlockMessages {
+  typedef Block<Bits> value_type;
+  typedef BlockVector<Bits> vector_type;
+  typedef BlockMatrix<Bits> matrix_type;
+  typedef BlockMatrix<Bits> pad_type;
+};
+
+struct MpzMessages {
+  typedef mpz_class value_type;
+  typedef std::vector<mpz_class> vector_type;
+  typedef std::vector<std::vector<mpz_class> > matrix_type;
+  typedef std::vector<std::vector<mpz_class> > pad_type;
+};
+
+#endif
@@ -0,0 +1,69 @@
+#ifndef OT_COMMON_CACHE_INFO_H
+#define OT_COMMON_CACHE_INFO_H
+
+#include <cstddef>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <unistd.h>
+
+// Data cache sizes of the machine, for loop blocking. Read once from sysconf (glibc), then
+// from /sys/devices/system/cpu/cpu0/cache where sysconf has no answer, with conservative
+// defaults when neither does. OT_L2_BYTES / OT_L3_BYTES in the environment override them.
+struct CacheSizes {
+  size_t l2;  // per core
+  size_t l3;  // shared, 0 if there is none
+};
+
+// "2048K" / "30M" / "262144" as written in sysfs
+inline size_t parse_cache_size(const std::string& text) {
+  char* end = nullptr;
+  unsigned long long value = strtoull(text.c_str(), &end, 10);
+  if (end != nullptr && (*end == 'K' || *end == 'k')) {
+    value <<= 10;
+  } else if (end != nullptr && (*end == 'M' || *end == 'm')) {
+    value <<= 20;
+  }
+  return size_t(value);
+}
+
+// Size of the level-`level` data or unified cache of cpu0 in sysfs, 0 if not found
+inline size_t sysfs_cache_size(int level) {
+  for (int index = 0; index < 8; ++index) {
+    std::string dir = "/sys/devices/system/cpu/cpu0/cache/index" + std::to_string(index) + "/";
+    std::ifstream level_file((dir + "level").c_str()), type_file((dir + "type").c_str()), size_file((dir + "size").c_str());
+    int found_level = 0;
+    std::string type, size;
+    if (!(level_file >> found_level) || !(type_file >> type) || !(size_file >> size)) {
+      continue;
+    }
+    if (found_level == level && type != "Instruction") {
+      return parse_cache_size(size);
+    }
+  }
+  return 0;
+}
+
+inline size_t detect_cache_size(int level, const char* env, size_t fallback) {
+  const char* text = getenv(env);
+  if (text != nullptr && parse_cache_size(text) > 0) {
+    return parse_cache_size(text);
+  }
+  long bytes = -1;
+#ifdef _SC_LEVEL2_CACHE_SIZE
+  bytes = sysconf(level == 2 ? _SC_LEVEL2_CACHE_SIZE : _SC_LEVEL3_CACHE_SIZE);
+#endif
+  if (bytes > 0) {
+    return size_t(bytes);
+  }
+  size_t sysfs = sysfs_cache_size(level);
+  return sysfs > 0 ? sysfs : fallback;
+}
+
+inline const CacheSizes& cache_sizes() {
+  static const CacheSizes sizes = {detect_cache_size(2, "OT_L2_BYTES", 256 * 1024),
+                                   detect_cache_size(3, "OT_L3_BYTES", 0)};
+  return sizes;
+}
+
+#endif
@@ -0,0 +1,115 @@
+#ifndef OT_COMMON_DATABASE_H
+#define OT_COMMON_DATABASE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "block.h"
+
+// Sender database file: a 64-byte header followed by n fixed-width records. Each record is
+// ceil(record_bits / 64) little-endian 64-bit limbs, least significant limb first, i.e. the
+// in-memory layout of Block<record_bits>, so the mapped pages are used as messages directly.
+// The header size keeps the first record 64-byte aligned in the mapping.
+
+const char kDatabaseMagic[8] = {'O', 'T', 'D', 'B', '0', '0', '0', '1'};
+
+struct DatabaseHeader {
+  char magic[8];
+  uint64_t n;
+  uint64_t record_bits;
+  uint64_t reserved[5];
+};
+
+inline DatabaseHeader database_header(uint64_t n, uint64_t record_bits) {
+  DatabaseHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, kDatabaseMagic, sizeof(kDatabaseMagic));
+  header.n = n;
+  header.record_bits = record_bits;
+  return header;
+}
+
+// Read-only memory mapping of a database of Block<Bits> records. Pages are faulted in as the
+// sender streams over them, so the database may be larger than RAM.
+template <unsigned Bits>
+class MappedDatabase {
+public:
+  MappedDatabase() : base_(nullptr), length_(0), n_(0) {}
+  ~MappedDatabase() { close(); }
+
+  // Maps path; prints the reason and returns false if it is not a database of Bits-bit records
+  bool open(const std::string& path) {
+    close();
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+      std::cerr << "\n ** Error: cannot open database " << path << std::endl;
+      return false;
+    }
+    struct stat st;
+    DatabaseHeader header;
+    bool ok = fstat(fd, &st) == 0 && size_t(st.st_size) >= sizeof(header) &&
+              pread(fd, &header, sizeof(header), 0) == ssize_t(sizeof(header)) &&
+              memcmp(header.magic, kDatabaseMagic, sizeof(kDatabaseMagic)) == 0;
+    // Divided rather than multiplied, so a huge header.n cannot wrap around
+    if (!ok || header.record_bits != Bits ||
+        header.n > (uint64_t(st.st_size) - sizeof(header)) / sizeof(Block<Bits>)) {
+      std::cerr << "\n ** Error: " << path << " is not a database of " << Bits << "-bit records" << std::endl;
+      ::close(fd);
+      return false;
+    }
+    length_ = sizeof(header) + header.n * sizeof(Block<Bits>);
+    void* base = mmap(nullptr, length_, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (base == MAP_FAILED) {
+      std::cerr << "\n ** Error: cannot map database " << path << std::endl;
+      length_ = 0;
+      return false;
+    }
+    // GenRes reads the records front to back
+    madvise(base, length_, MADV_SEQUENTIAL);
+    base_ = static_cast<char*>(base);
+    n_ = header.n;
+    return true;
+  }
+
+  void close() {
+    if (base_ != nullptr) {
+      munmap(base_, length_);
+    }
+    base_ = nullptr;
+    length_ = 0;
+    n_ = 0;
+  }
+
+  bool is_open() const { return base_ != nullptr; }
+  size_t size() const { return n_; }
+  const Block<Bits>* data() const { return reinterpret_cast<const Block<Bits>*>(base_ + sizeof(DatabaseHeader)); }
+  const Block<Bits>& operator[](size_t i) const { return data()[i]; }
+
+private:
+  MappedDatabase(const MappedDatabase&);
+  MappedDatabase& operator=(const MappedDatabase&);
+
+  char* base_;
+  size_t length_;
+  size_t n_;
+};
+
+// Record as a message of the driver's Messages type, e.g. to check retrieved messages
+template <unsigned Bits>
+void load_record(const Block<Bits>& record, Block<Bits>& out) {
+  out = record;
+}
+
+template <unsigned Bits>
+void load_record(const Block<Bits>& record, mpz_class& out) {
+  out = record.to_mpz();
+}
+
+#endif
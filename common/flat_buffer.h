@@ -0,0 +1,91 @@
+#ifndef OT_COMMON_FLAT_BUFFER_H
+#define OT_COMMON_FLAT_BUFFER_H
+
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+#include <vector>
+#include "alloc_counter.h"
+
+// Allocator returning Align-byte aligned storage, so vectors of blocks can be
+// handed to vector loads without peeling
+template <typename T, size_t Align = 64>
+struct AlignedAllocator {
+  typedef T value_type;
+  template <typename U> struct rebind { typedef AlignedAllocator<U, Align> other; };
+
+  AlignedAllocator() {}
+  template <typename U> AlignedAllocator(const AlignedAllocator<U, Align>&) {}
+
+  T* allocate(size_t count) {
+    void* p = nullptr;
+    if (count == 0) {
+      count = 1;
+    }
+    if (posix_memalign(&p, Align, count * sizeof(T)) != 0) {
+      throw std::bad_alloc();
+    }
+    count_heap_allocation();
+    return static_cast<T*>(p);
+  }
+  void deallocate(T* p, size_t) { free(p); }
+};
+
+template <typename T, typename U, size_t Align>
+bool operator==(const AlignedAllocator<T, Align>&, const AlignedAllocator<U, Align>&) { return true; }
+template <typename T, typename U, size_t Align>
+bool operator!=(const AlignedAllocator<T, Align>&, const AlignedAllocator<U, Align>&) { return false; }
+
+// Non-owning rows x cols window onto a flat buffer, e.g. a region of an Arena; indexes like
+// FlatMatrix
+template <typename T>
+class MatrixView {
+public:
+  MatrixView() : data_(nullptr), rows_(0), cols_(0) {}
+  MatrixView(T* data, size_t rows, size_t cols) : data_(data), rows_(rows), cols_(cols) {}
+  template <typename U>
+  MatrixView(const MatrixView<U>& other) : data_(other.data()), rows_(other.rows()), cols_(other.cols()) {}
+
+  size_t rows() const { return rows_; }
+  size_t cols() const { return cols_; }
+  size_t size() const { return rows_ * cols_; }
+  T* data() const { return data_; }
+  T* operator[](size_t row) const { return data_ + row * cols_; }
+
+private:
+  T* data_;
+  size_t rows_;
+  size_t cols_;
+};
+
+// rows x cols elements in one contiguous, aligned buffer; m[j] is a pointer to row j,
+// so m[j][i] reads the same as for a vector of vectors
+template <typename T>
+class FlatMatrix {
+public:
+  FlatMatrix() : rows_(0), cols_(0) {}
+  FlatMatrix(size_t rows, size_t cols) : rows_(rows), cols_(cols), data_(rows * cols) {}
+
+  void resize(size_t rows, size_t cols) {
+    rows_ = rows;
+    cols_ = cols;
+    data_.resize(rows * cols);
+  }
+
+  size_t rows() const { return rows_; }
+  size_t cols() const { return cols_; }
+  size_t size() const { return data_.size(); }
+  T* data() { return data_.data(); }
+  const T* data() const { return data_.data(); }
+  T* operator[](size_t row) { return data_.data() + row * cols_; }
+  const T* operator[](size_t row) const { return data_.data() + row * cols_; }
+  MatrixView<T> view() { return MatrixView<T>(data(), rows_, cols_); }
+  MatrixView<const T> view() const { return MatrixView<const T>(data(), rows_, cols_); }
+
+private:
+  size_t rows_;
+  size_t cols_;
+  std::vector<T, AlignedAllocator<T> > data_;
+};
+
+#endif
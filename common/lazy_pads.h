@@ -0,0 +1,59 @@
+#ifndef OT_COMMON_LAZY_PADS_H
+#define OT_COMMON_LAZY_PADS_H
+
+#include <cstddef>
+#include <cstdint>
+#include "block.h"
+#include "prg.h"
+
+// Seed-compressed pads: the number_of_OT x n pads of Setup are never stored. Pad r[j][i] is
+// word range [i * kWords, (i + 1) * kWords) of PRG stream j, so GenRes expands each row in
+// chunks as it streams over m, and retrieval regenerates a single pad in O(1). Memory is one
+// PRG key instead of n * number_of_OT * bit_size bits.
+
+template <unsigned Bits>
+class LazyPads;
+
+// r[j] of a LazyPads; r[j][i] regenerates the pad by value
+template <unsigned Bits>
+struct LazyPadRow {
+  const LazyPads<Bits>* pads;
+  size_t row;
+  Block<Bits> operator[](size_t i) const { return pads->at(row, i); }
+};
+
+template <unsigned Bits>
+class LazyPads {
+public:
+  LazyPads() : rows_(0), cols_(0), prg_(PrgSeed()) {}
+  LazyPads(size_t rows, size_t cols, const PrgSeed& seed, PrgKind kind = best_prg_kind())
+      : rows_(rows), cols_(cols), prg_(seed, kind) {}
+
+  size_t rows() const { return rows_; }
+  size_t cols() const { return cols_; }
+
+  Block<Bits> at(size_t row, size_t i) const { return prg_.template block_at<Bits>(row, i); }
+
+  // Expands pads [begin, begin + count) of row into out
+  void expand(size_t row, size_t begin, Block<Bits>* out, size_t count) const {
+    prg_.fill_blocks(row, begin, out, count);
+  }
+
+  LazyPadRow<Bits> operator[](size_t row) const {
+    LazyPadRow<Bits> r = {this, row};
+    return r;
+  }
+
+private:
+  size_t rows_;
+  size_t cols_;
+  Prg prg_;
+};
+
+// BlockMessages with seed-compressed pads
+template <unsigned Bits>
+struct LazyBlockMessages : BlockMessages<Bits> {
+  typedef LazyPads<Bits> pad_type;
+};
+
+#endif
@@ -0,0 +1,156 @@
+#ifndef OT_COMMON_OFFLINE_POOL_H
+#define OT_COMMON_OFFLINE_POOL_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "prg.h"
+
+// Offline/online split. Everything a batch needs that depends neither on the receiver's
+// indices nor on m (the pads, the random query material) is made ahead of demand by a
+// background producer thread into a bounded pool; the online path takes a ready item and only
+// runs the index-dependent work. Items are numbered 0, 1, 2, ... in production order and
+// taken in that order, and item s draws its randomness from offline_seed(master, s, ...), so
+// the sender's and the receiver's pools built from the same master seed hand out matching
+// pads batch by batch.
+
+// Seed of item `sequence` for one use (pads, query randomness, ...), from the pool's master
+// seed: a block of PRG stream `sequence` at word offset 2 * purpose
+inline PrgSeed offline_seed(const PrgSeed& master, uint64_t sequence, uint64_t purpose) {
+  PrgSeed seed;
+  Prg(master).fill(sequence, 2 * purpose, seed.w, PrgSeed::kWords);
+  return seed;
+}
+
+// What the pool has done so far
+struct PoolMetrics {
+  size_t capacity;
+  size_t depth;            // items ready now
+  uint64_t produced;
+  uint64_t taken;
+  uint64_t misses;         // takes that found the pool empty and waited for the producer
+  double produce_seconds;  // producer time spent making items
+  double wait_seconds;     // online time spent waiting in take()
+
+  // Items the producer makes per second while it is busy: the rate the pool can refill at
+  double refill_per_s() const { return produce_seconds > 0 ? produced / produce_seconds : 0; }
+};
+
+// Bounded pool of `capacity` items of T. produce(item, sequence) fills one item in place, on
+// the producer thread; take() swaps a ready item with the caller's object, so the buffers the
+// caller hands back are refilled by the producer and a pool of stable shape stops allocating.
+// The producer sleeps while the pool is full, and does not start an item while the online
+// path holds the pool paused: its setup work shares the worker threads (ThreadPool::global())
+// with the online phases, so refills are kept to the idle time between batches. An item
+// already being made when pause() is called is finished first, and a take() that finds the
+// pool empty has the next item made even while paused. T must be
+// default-constructible and swappable.
+template <typename T>
+class OfflinePool {
+public:
+  typedef std::function<void(T&, uint64_t)> Produce;
+
+  OfflinePool(size_t capacity, const Produce& produce)
+      : slots_(capacity > 0 ? capacity : 1), produce_(produce), head_(0), tail_(0), paused_(0), stop_(false), misses_(0),
+        produce_seconds_(0), wait_seconds_(0) {
+    producer_ = std::thread([this] { run(); });
+  }
+
+  ~OfflinePool() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+    not_full_.notify_all();
+    producer_.join();
+  }
+
+  // Swaps the oldest ready item into out, waiting for the producer if there is none. Returns
+  // the item's sequence number.
+  uint64_t take(T& out) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (head_ == tail_) {
+      ++misses_;
+      not_full_.notify_one();
+      std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+      not_empty_.wait(lock, [this] { return head_ != tail_; });
+      wait_seconds_ += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+    const uint64_t sequence = tail_;
+    lock.unlock();
+    // The slot stays the consumer's until tail_ moves past it
+    using std::swap;
+    swap(out, slots_[sequence % slots_.size()]);
+    lock.lock();
+    ++tail_;
+    lock.unlock();
+    not_full_.notify_one();
+    return sequence;
+  }
+
+  // Online section: no new item is started between pause() and the matching resume()
+  void pause() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ++paused_;
+  }
+
+  void resume() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      --paused_;
+    }
+    not_full_.notify_one();
+  }
+
+  PoolMetrics metrics() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    PoolMetrics m = {slots_.size(), size_t(head_ - tail_), head_, tail_, misses_, produce_seconds_, wait_seconds_};
+    return m;
+  }
+
+private:
+  void run() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (;;) {
+      not_full_.wait(lock, [this] { return stop_ || head_ == tail_ || (paused_ == 0 && head_ - tail_ < slots_.size()); });
+      if (stop_) {
+        return;
+      }
+      const uint64_t sequence = head_;
+      lock.unlock();
+      // The slot stays the producer's until head_ moves past it
+      std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+      produce_(slots_[sequence % slots_.size()], sequence);
+      double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+      lock.lock();
+      produce_seconds_ += seconds;
+      ++head_;
+      not_empty_.notify_one();
+    }
+  }
+
+  OfflinePool(const OfflinePool&);
+  OfflinePool& operator=(const OfflinePool&);
+
+  std::vector<T> slots_;
+  Produce produce_;
+  mutable std::mutex mutex_;
+  std::condition_variable not_empty_;
+  std::condition_variable not_full_;
+  uint64_t head_;  // items produced
+  uint64_t tail_;  // items taken
+  int paused_;
+  bool stop_;
+  uint64_t misses_;
+  double produce_seconds_;
+  double wait_seconds_;
+  std::thread producer_;
+};
+
+#endif
@@ -0,0 +1,84 @@
+#ifndef OT_COMMON_PERMUTATION_H
+#define OT_COMMON_PERMUTATION_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include "flat_buffer.h"
+
+// One permutation of [0, n) per invocation, kept together with its dense inverse so that a
+// lookup in either direction is a single array read. forward(j)[k] is the message placed at
+// position k; inverse(j)[i] is the position of message i. Both live in flat count x n buffers
+// (4 bytes per entry each), instead of a hash map of n nodes per invocation.
+class PermutationSet {
+public:
+  PermutationSet() {}
+  PermutationSet(size_t count, size_t n) : forward_(count, n), inverse_(count, n) {}
+
+  void resize(size_t count, size_t n) {
+    forward_.resize(count, n);
+    inverse_.resize(count, n);
+  }
+
+  size_t count() const { return forward_.rows(); }
+  size_t n() const { return forward_.cols(); }
+  int* forward(size_t j) { return forward_[j]; }
+  const int* forward(size_t j) const { return forward_[j]; }
+  int* inverse(size_t j) { return inverse_[j]; }
+  const int* inverse(size_t j) const { return inverse_[j]; }
+
+  // Positions of messages [begin, begin + len) of invocation j; scratch is not needed here
+  const int* positions(size_t j, size_t begin, size_t, int*) const { return inverse_[j] + begin; }
+
+  // Messages placed at positions [begin, begin + len) of invocation j. Needs the forward rows,
+  // which a query deserialized from the wire does not carry.
+  const int* sources(size_t j, size_t begin, size_t, int*) const { return forward_[j] + begin; }
+
+  // Rebuilds inverse(j) from forward(j) in one linear pass
+  void invert(size_t j) {
+    const int* f = forward_[j];
+    int* inv = inverse_[j];
+    for (size_t k = 0; k < n(); ++k) {
+      inv[f[k]] = int(k);
+    }
+  }
+
+private:
+  FlatMatrix<int> forward_;
+  FlatMatrix<int> inverse_;
+};
+
+// Words of the bitmap check_inverse marks the positions of [0, n) in
+inline size_t inverse_check_words(size_t n) { return (n + 63) / 64; }
+
+// True if inv is a permutation of [0, n): every entry in range and none repeated, so the
+// scatter writes every position exactly once. One linear pass over seen, a caller-owned bitmap
+// of inverse_check_words(n) words that is cleared here.
+inline bool check_inverse(const int* inv, size_t n, uint64_t* seen) {
+  std::fill(seen, seen + inverse_check_words(n), uint64_t(0));
+  for (size_t i = 0; i < n; ++i) {
+    if (inv[i] < 0 || size_t(inv[i]) >= n) {
+      return false;
+    }
+    const size_t k = size_t(inv[i]);
+    const uint64_t bit = uint64_t(1) << (k % 64);
+    if (seen[k / 64] & bit) {
+      return false;
+    }
+    seen[k / 64] |= bit;
+  }
+  return true;
+}
+
+// True if fwd is the inverse of inv, a permutation of [0, n) that passed check_inverse:
+// fwd[inv[i]] == i for every i, which leaves no entry of fwd unchecked
+inline bool check_forward(const int* fwd, const int* inv, size_t n) {
+  for (size_t i = 0; i < n; ++i) {
+    if (fwd[inv[i]] != int(i)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+#endif
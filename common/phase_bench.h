@@ -0,0 +1,288 @@
+#ifndef OT_COMMON_PHASE_BENCH_H
+#define OT_COMMON_PHASE_BENCH_H
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <ostream>
+#include <vector>
+#include "trace.h"
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// Benchmark harness for the five OT phases. Each phase is timed with steady_clock (wall
+// clock, so multi-threaded phases report latency rather than summed CPU time); the first
+// `warmup` iterations are run but not recorded, and the report gives min / median / p99 per
+// phase plus throughput. With OT_PERF=1 in the environment, cycles and cache misses are read
+// around each phase through perf_event_open when the kernel allows it. In an OT_TRACE build
+// the report adds the trace counters of the recorded iterations, and with OT_TRACE_FILE=path
+// their spans are written there as Chrome trace-event JSON.
+
+enum Phase { kPhaseSetup = 0, kPhaseGenQuery, kPhaseGenRes, kPhaseOblFilter, kPhaseRetrieve, kPhaseCount };
+
+inline const char* phase_name(int phase) {
+  static const char* names[kPhaseCount + 1] = {"Setup", "GenQuery", "GenRes", "OblFilter", "Retrieve", "Total"};
+  return names[phase];
+}
+
+// Process-wide hardware counters: cycles and cache misses. The counters are inherited by
+// threads created after open(), so open them before the first parallel phase starts the
+// thread pool; reads then cover every pool thread.
+class PerfCounters {
+public:
+  enum { kCycles = 0, kCacheMisses, kCount };
+
+  PerfCounters() {
+    fds_[kCycles] = fds_[kCacheMisses] = -1;
+  }
+  ~PerfCounters() { close(); }
+
+  bool open() {
+#ifdef __linux__
+    const uint64_t configs[kCount] = {PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_CACHE_MISSES};
+    for (int k = 0; k < kCount; ++k) {
+      perf_event_attr attr;
+      memset(&attr, 0, sizeof(attr));
+      attr.size = sizeof(attr);
+      attr.type = PERF_TYPE_HARDWARE;
+      attr.config = configs[k];
+      attr.inherit = 1;
+      attr.exclude_kernel = 1;
+      attr.exclude_hv = 1;
+      fds_[k] = int(syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0));
+      if (fds_[k] < 0) {
+        close();
+        return false;
+      }
+    }
+    return true;
+#else
+    return false;
+#endif
+  }
+
+  bool is_open() const { return fds_[kCycles] >= 0; }
+
+  // Current counts; zero when the counters are not open
+  void read(uint64_t values[kCount]) const {
+    for (int k = 0; k < kCount; ++k) {
+      values[k] = 0;
+#ifdef __linux__
+      if (fds_[k] >= 0 && ::read(fds_[k], &values[k], sizeof(uint64_t)) != sizeof(uint64_t)) {
+        values[k] = 0;
+      }
+#endif
+    }
+  }
+
+private:
+  void close() {
+    for (int k = 0; k < kCount; ++k) {
+#ifdef __linux__
+      if (fds_[k] >= 0) {
+        ::close(fds_[k]);
+      }
+#endif
+      fds_[k] = -1;
+    }
+  }
+
+  PerfCounters(const PerfCounters&);
+  PerfCounters& operator=(const PerfCounters&);
+
+  int fds_[kCount];
+};
+
+struct PhaseSummary {
+  double min_ns;
+  double median_ns;
+  double p99_ns;
+  double cycles;        // median, 0 without counters
+  double cache_misses;  // median, 0 without counters
+};
+
+// Usage, per iteration:
+//   bench.begin();  setup(...);  bench.lap(kPhaseSetup);  gen_query(...);  bench.lap(kPhaseGenQuery); ...
+//   bench.check(retrieved == expected);  bench.end();
+class PhaseBench {
+public:
+  PhaseBench(int warmup, int iterations) : warmup_(warmup), iterations_(iterations), iteration_(0), failures_(0), checks_(0) {
+    const char* perf = getenv("OT_PERF");
+    if (perf != nullptr && perf[0] == '1') {
+      counters_.open();
+    }
+    for (int p = 0; p <= kPhaseCount; ++p) {
+      ns_[p].reserve(iterations);
+    }
+    if (kTraceCompiled && getenv("OT_TRACE_FILE") != nullptr) {
+      trace_start();
+    }
+  }
+
+  int total_iterations() const { return warmup_ + iterations_; }
+  int iterations() const { return iterations_; }
+  int warmup() const { return warmup_; }
+  bool has_counters() const { return counters_.is_open(); }
+
+  // Starts an iteration; the clock for the first phase starts here
+  void begin() {
+    if (kTraceCompiled && iteration_ == warmup_) {
+      // warm-up iterations stay out of the trace
+      trace_reset();
+    }
+    for (int p = 0; p < kPhaseCount; ++p) {
+      phase_ns_[p] = 0;
+      phase_counts_[p][0] = phase_counts_[p][1] = 0;
+    }
+    mark();
+  }
+
+  // Ends the current phase and starts the next one
+  void lap(Phase phase) {
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    uint64_t counts[PerfCounters::kCount];
+    counters_.read(counts);
+    phase_ns_[phase] += double(std::chrono::duration_cast<std::chrono::nanoseconds>(now - last_).count());
+    for (int k = 0; k < PerfCounters::kCount; ++k) {
+      phase_counts_[phase][k] += double(counts[k] - last_counts_[k]);
+    }
+    mark();
+  }
+
+  // Restarts the clock without charging the time since the last lap to any phase
+  void mark() {
+    counters_.read(last_counts_);
+    last_ = std::chrono::steady_clock::now();
+  }
+
+  // Charges ns measured elsewhere (e.g. reported by the other party) to phase
+  void record(Phase phase, double ns) { phase_ns_[phase] += ns; }
+
+  // Records one correctness check; warm-up iterations are checked too
+  void check(bool ok) {
+    ++checks_;
+    if (!ok) {
+      ++failures_;
+    }
+  }
+
+  // Ends an iteration; it is recorded unless it was a warm-up iteration
+  void end() {
+    if (iteration_++ < warmup_) {
+      return;
+    }
+    double total = 0;
+    for (int p = 0; p < kPhaseCount; ++p) {
+      ns_[p].push_back(phase_ns_[p]);
+      cycles_[p].push_back(phase_counts_[p][PerfCounters::kCycles]);
+      misses_[p].push_back(phase_counts_[p][PerfCounters::kCacheMisses]);
+      total += phase_ns_[p];
+    }
+    ns_[kPhaseCount].push_back(total);
+  }
+
+  size_t failures() const { return failures_; }
+  size_t checks() const { return checks_; }
+
+  // phase may be kPhaseCount for the per-iteration total
+  PhaseSummary summary(int phase) const {
+    PhaseSummary s = {0, 0, 0, 0, 0};
+    if (ns_[phase].empty()) {
+      return s;
+    }
+    std::vector<double> sorted = ns_[phase];
+    std::sort(sorted.begin(), sorted.end());
+    s.min_ns = sorted.front();
+    s.median_ns = percentile(sorted, 50);
+    s.p99_ns = percentile(sorted, 99);
+    if (phase < kPhaseCount && has_counters()) {
+      std::vector<double> c = cycles_[phase], m = misses_[phase];
+      std::sort(c.begin(), c.end());
+      std::sort(m.begin(), m.end());
+      s.cycles = percentile(c, 50);
+      s.cache_misses = percentile(m, 50);
+    }
+    return s;
+  }
+
+  // Per-phase table plus throughput for number_of_OT OTs per iteration over message_bytes of
+  // messages each (n * bytes per message): OTs/s and GB/s from the median total, and the
+  // GenRes rate over the same bytes
+  void report(std::ostream& out, size_t number_of_OT, double message_bytes) const {
+    out << "\n\n================== Runtime Breakdown (ms; " << iterations_ << " runs after " << warmup_
+        << " warm-up) ========================" << std::endl;
+    out << "\n " << std::left << std::setw(10) << "Phase" << std::right << std::setw(12) << "min" << std::setw(12)
+        << "median" << std::setw(12) << "p99";
+    if (has_counters()) {
+      out << std::setw(16) << "cycles" << std::setw(16) << "cache-misses";
+    }
+    out << std::endl;
+    for (int p = 0; p <= kPhaseCount; ++p) {
+      PhaseSummary s = summary(p);
+      out << " " << std::left << std::setw(10) << phase_name(p) << std::right << std::fixed << std::setprecision(4)
+          << std::setw(12) << s.min_ns / 1e6 << std::setw(12) << s.median_ns / 1e6 << std::setw(12) << s.p99_ns / 1e6;
+      if (has_counters() && p < kPhaseCount) {
+        out << std::setprecision(0) << std::setw(16) << s.cycles << std::setw(16) << s.cache_misses;
+      }
+      out << std::endl;
+    }
+    out.unsetf(std::ios::floatfield);
+    out << std::setprecision(6);
+    double total_s = summary(kPhaseCount).median_ns / 1e9;
+    double genres_s = summary(kPhaseGenRes).median_ns / 1e9;
+    double bytes = double(number_of_OT) * message_bytes;
+    if (total_s > 0) {
+      out << "\n Throughput: " << number_of_OT / total_s << " OTs/s, " << bytes / total_s / 1e9 << " GB/s";
+      if (genres_s > 0) {
+        out << " (GenRes " << bytes / genres_s / 1e9 << " GB/s)";
+      }
+      out << std::endl;
+    }
+    if (getenv("OT_PERF") != nullptr && !has_counters()) {
+      out << "\n Hardware counters unavailable (perf_event_open failed)" << std::endl;
+    }
+    trace_report(out, iterations_);
+    const char* trace_file = getenv("OT_TRACE_FILE");
+    if (kTraceCompiled && trace_file != nullptr) {
+      trace_stop();
+      if (trace_write_json(trace_file)) {
+        out << "\n Trace written to " << trace_file << std::endl;
+      }
+    }
+    out << "\n Correctness: " << checks_ - failures_ << " of " << checks_ << " retrieved messages match m[index]"
+        << std::endl;
+  }
+
+  // Nearest-rank percentile of sorted values
+  static double percentile(const std::vector<double>& sorted, double pct) {
+    size_t rank = size_t(pct / 100.0 * sorted.size() + 0.999999);
+    rank = std::max<size_t>(1, std::min(rank, sorted.size()));
+    return sorted[rank - 1];
+  }
+
+private:
+
+  int warmup_;
+  int iterations_;
+  int iteration_;
+  size_t failures_;
+  size_t checks_;
+  PerfCounters counters_;
+  std::chrono::steady_clock::time_point last_;
+  uint64_t last_counts_[PerfCounters::kCount];
+  double phase_ns_[kPhaseCount];
+  double phase_counts_[kPhaseCount][PerfCounters::kCount];
+  std::vector<double> ns_[kPhaseCount + 1];
+  std::vector<double> cycles_[kPhaseCount];
+  std::vector<double> misses_[kPhaseCount];
+};
+
+#endif
@@ -0,0 +1,268 @@
+#ifndef OT_COMMON_PRG_H
+#define OT_COMMON_PRG_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include "block.h"
+#include "trace.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define OT_PRG_X86 1
+#endif
+
+// Counter-mode pseudorandom generator for pads. A 128-bit seed keys either AES-128 (AES-NI)
+// or ChaCha20 with a 128-bit key; both expose the same keystream layout: stream s is an
+// independent sequence of 64-bit words, and word w of stream s can be produced without
+// generating anything before it. Phase 1 uses stream = invocation and word offset =
+// index * words per message, so any (invocation, index) range can be filled by any thread.
+// The keystream is a function of (kind, seed): pass the kind explicitly when pads must be
+// reproduced on a machine with different CPU features. A kind this CPU cannot run aborts
+// rather than silently expanding a different keystream; check prg_supported first.
+
+typedef Block<128> PrgSeed;
+
+enum PrgKind { kPrgAesCtr = 0, kPrgChaCha20 };
+
+inline const char* prg_name(PrgKind kind) {
+  return kind == kPrgAesCtr ? "aes-ctr" : "chacha20";
+}
+
+inline bool prg_supported(PrgKind kind) {
+  if (kind != kPrgAesCtr && kind != kPrgChaCha20) {
+    return false;
+  }
+#ifdef OT_PRG_X86
+  if (kind == kPrgAesCtr) {
+    return __builtin_cpu_supports("aes") && __builtin_cpu_supports("sse4.1");
+  }
+#else
+  if (kind == kPrgAesCtr) {
+    return false;
+  }
+#endif
+  return true;
+}
+
+// AES-NI when available, ChaCha20 otherwise
+inline PrgKind best_prg_kind() {
+  return prg_supported(kPrgAesCtr) ? kPrgAesCtr : kPrgChaCha20;
+}
+
+// Fresh seed from the OS entropy source
+inline PrgSeed random_prg_seed() {
+  std::random_device rd;
+  PrgSeed seed;
+  for (size_t k = 0; k < PrgSeed::kWords; ++k) {
+    seed.w[k] = (uint64_t(rd()) << 32) | rd();
+  }
+  return seed;
+}
+
+// Expands a 64-bit value into a seed, for reproducible runs
+inline PrgSeed prg_seed(uint64_t value) {
+  PrgSeed seed;
+  seed.w[0] = value;
+  return seed;
+}
+
+namespace prg_detail {
+
+inline uint32_t rotl32(uint32_t v, int c) { return (v << c) | (v >> (32 - c)); }
+
+#define OT_CHACHA_QR(a, b, c, d) \
+  a += b; d ^= a; d = rotl32(d, 16); \
+  c += d; b ^= c; b = rotl32(b, 12); \
+  a += b; d ^= a; d = rotl32(d, 8); \
+  c += d; b ^= c; b = rotl32(b, 7);
+
+// One 64-byte ChaCha20 block as 8 little-endian words; key is 8 32-bit words,
+// the state counter/nonce words are (counter, stream) as 64-bit halves
+inline void chacha20_block(const uint32_t constants[4], const uint32_t key[8], uint64_t counter, uint64_t stream, uint64_t out[8]) {
+  uint32_t in[16];
+  memcpy(in, constants, 4 * sizeof(uint32_t));
+  memcpy(in + 4, key, 8 * sizeof(uint32_t));
+  in[12] = uint32_t(counter);
+  in[13] = uint32_t(counter >> 32);
+  in[14] = uint32_t(stream);
+  in[15] = uint32_t(stream >> 32);
+  uint32_t x[16];
+  memcpy(x, in, sizeof(x));
+  for (int round = 0; round < 10; ++round) {
+    OT_CHACHA_QR(x[0], x[4], x[8], x[12])
+    OT_CHACHA_QR(x[1], x[5], x[9], x[13])
+    OT_CHACHA_QR(x[2], x[6], x[10], x[14])
+    OT_CHACHA_QR(x[3], x[7], x[11], x[15])
+    OT_CHACHA_QR(x[0], x[5], x[10], x[15])
+    OT_CHACHA_QR(x[1], x[6], x[11], x[12])
+    OT_CHACHA_QR(x[2], x[7], x[8], x[13])
+    OT_CHACHA_QR(x[3], x[4], x[9], x[14])
+  }
+  for (int k = 0; k < 8; ++k) {
+    out[k] = uint64_t(x[2 * k] + in[2 * k]) | (uint64_t(x[2 * k + 1] + in[2 * k + 1]) << 32);
+  }
+}
+
+#undef OT_CHACHA_QR
+
+#ifdef OT_PRG_X86
+#define OT_AES_EXPAND(k, rcon) aes_expand_step(k, _mm_aeskeygenassist_si128(k, rcon))
+
+__attribute__((target("aes,sse4.1")))
+inline __m128i aes_expand_step(__m128i key, __m128i gen) {
+  gen = _mm_shuffle_epi32(gen, 0xff);
+  key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+  key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+  key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+  return _mm_xor_si128(key, gen);
+}
+
+__attribute__((target("aes,sse4.1")))
+inline void aes128_key_schedule(const uint64_t key[2], __m128i rk[11]) {
+  rk[0] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(key));
+  rk[1] = OT_AES_EXPAND(rk[0], 0x01);
+  rk[2] = OT_AES_EXPAND(rk[1], 0x02);
+  rk[3] = OT_AES_EXPAND(rk[2], 0x04);
+  rk[4] = OT_AES_EXPAND(rk[3], 0x08);
+  rk[5] = OT_AES_EXPAND(rk[4], 0x10);
+  rk[6] = OT_AES_EXPAND(rk[5], 0x20);
+  rk[7] = OT_AES_EXPAND(rk[6], 0x40);
+  rk[8] = OT_AES_EXPAND(rk[7], 0x80);
+  rk[9] = OT_AES_EXPAND(rk[8], 0x1b);
+  rk[10] = OT_AES_EXPAND(rk[9], 0x36);
+}
+
+#undef OT_AES_EXPAND
+
+// Encrypts counter blocks (stream, first), (stream, first + 1), ... into out, 2 words each.
+// Eight blocks are kept in flight to hide the aesenc latency.
+__attribute__((target("aes,sse4.1")))
+inline void aes128_ctr(const __m128i rk[11], uint64_t stream, uint64_t first, uint64_t* out, size_t blocks) {
+  size_t b = 0;
+  for (; b + 8 <= blocks; b += 8) {
+    __m128i x[8];
+    for (int k = 0; k < 8; ++k) {
+      x[k] = _mm_xor_si128(_mm_set_epi64x(int64_t(stream), int64_t(first + b + k)), rk[0]);
+    }
+    for (int r = 1; r < 10; ++r) {
+      for (int k = 0; k < 8; ++k) {
+        x[k] = _mm_aesenc_si128(x[k], rk[r]);
+      }
+    }
+    for (int k = 0; k < 8; ++k) {
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 2 * (b + k)), _mm_aesenclast_si128(x[k], rk[10]));
+    }
+  }
+  for (; b < blocks; ++b) {
+    __m128i x = _mm_xor_si128(_mm_set_epi64x(int64_t(stream), int64_t(first + b)), rk[0]);
+    for (int r = 1; r < 10; ++r) {
+      x = _mm_aesenc_si128(x, rk[r]);
+    }
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 2 * b), _mm_aesenclast_si128(x, rk[10]));
+  }
+}
+#endif
+
+} // namespace prg_detail
+
+class Prg {
+public:
+  explicit Prg(const PrgSeed& seed, PrgKind kind = best_prg_kind()) : kind_(kind) {
+    if (!prg_supported(kind_)) {
+      fprintf(stderr, "\n ** Error: PRG kind %u is not supported on this CPU\n", unsigned(kind_));
+      abort();
+    }
+#ifdef OT_PRG_X86
+    if (kind_ == kPrgAesCtr) {
+      prg_detail::aes128_key_schedule(seed.w, round_keys_);
+    }
+#endif
+    // 128-bit ChaCha key: "expand 16-byte k" constants with the key used twice
+    static const uint32_t tau[4] = {0x61707865, 0x3120646e, 0x79622d36, 0x6b206574};
+    memcpy(constants_, tau, sizeof(constants_));
+    for (int k = 0; k < 4; ++k) {
+      key_[k] = key_[k + 4] = uint32_t(seed.w[k / 2] >> (32 * (k % 2)));
+    }
+  }
+
+  PrgKind kind() const { return kind_; }
+
+  // Writes words of keystream `stream` starting at word `offset` into out
+  void fill(uint64_t stream, uint64_t offset, uint64_t* out, size_t words) const {
+    const size_t kBlockWords = kind_ == kPrgAesCtr ? 2 : 8;
+    uint64_t tmp[8];
+    uint64_t block = offset / kBlockWords;
+    size_t skip = size_t(offset % kBlockWords);
+    if (skip != 0) {
+      generate(stream, block, tmp, 1);
+      size_t take = std::min(kBlockWords - skip, words);
+      memcpy(out, tmp + skip, take * sizeof(uint64_t));
+      out += take;
+      words -= take;
+      ++block;
+    }
+    size_t whole = words / kBlockWords;
+    generate(stream, block, out, whole);
+    out += whole * kBlockWords;
+    words -= whole * kBlockWords;
+    if (words != 0) {
+      generate(stream, block + whole, tmp, 1);
+      memcpy(out, tmp, words * sizeof(uint64_t));
+    }
+  }
+
+  // Fills count pads of stream with values uniform over [0, 2^Bits), starting at pad index
+  template <unsigned Bits>
+  void fill_blocks(uint64_t stream, uint64_t index, Block<Bits>* out, size_t count) const {
+    OT_TRACE_SCOPE(kTracePrg, count * sizeof(Block<Bits>));
+    fill_blocks_untraced(stream, index, out, count);
+  }
+
+  // Single pad, for random access; too small a call to trace
+  template <unsigned Bits>
+  Block<Bits> block_at(uint64_t stream, uint64_t index) const {
+    Block<Bits> b;
+    fill_blocks_untraced(stream, index, &b, 1);
+    return b;
+  }
+
+private:
+  template <unsigned Bits>
+  void fill_blocks_untraced(uint64_t stream, uint64_t index, Block<Bits>* out, size_t count) const {
+    static_assert(sizeof(Block<Bits>) == Block<Bits>::kWords * sizeof(uint64_t), "Block must be padding-free");
+    fill(stream, index * Block<Bits>::kWords, out->w, count * Block<Bits>::kWords);
+    if (Bits % 64 != 0) {
+      const uint64_t top = (uint64_t(1) << (Bits % 64)) - 1;
+      for (size_t i = 0; i < count; ++i) {
+        out[i].w[Block<Bits>::kWords - 1] &= top;
+      }
+    }
+  }
+
+  // count keystream blocks starting at block index first
+  void generate(uint64_t stream, uint64_t first, uint64_t* out, size_t count) const {
+#ifdef OT_PRG_X86
+    if (kind_ == kPrgAesCtr) {
+      prg_detail::aes128_ctr(round_keys_, stream, first, out, count);
+      return;
+    }
+#endif
+    for (size_t b = 0; b < count; ++b) {
+      prg_detail::chacha20_block(constants_, key_, first + b, stream, out + 8 * b);
+    }
+  }
+
+  PrgKind kind_;
+#ifdef OT_PRG_X86
+  __m128i round_keys_[11];
+#endif
+  uint32_t constants_[4];
+  uint32_t key_[8];
+};
+
+#endif
@@ -0,0 +1,158 @@
+#ifndef OT_COMMON_PRP_H
+#define OT_COMMON_PRP_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include "flat_buffer.h"
+#include "prg.h"
+#include "thread_pool.h"
+
+// Keyed small-domain pseudorandom permutations of [0, n), one per invocation, for queries
+// that are sent as a key instead of a shuffled vector of n ints. pi_j is a balanced Feistel
+// network over [0, 2^(2h)) with 2^(2h) >= n, restricted to [0, n) by cycle walking: values
+// that land outside the domain are encrypted again until they fall inside, which keeps the
+// map a permutation of [0, n). Since 2^(2h) < 4n, fewer than four passes are expected.
+//
+// Round r of pi_j uses F(R) = low h bits of word (r << h) | R of PRG stream j, so one Feistel
+// pass costs kRounds PRG words. The sender, which evaluates pi_j on all n messages, instead
+// tabulates the kRounds << h words of each invocation once (O(sqrt n) work) and evaluates by
+// table lookups.
+class FeistelPrp {
+public:
+  // Small halves make the Feistel network weak at 4 rounds; 8 keeps a margin for tiny n
+  static const unsigned kRounds = 8;
+
+  FeistelPrp(const PrgSeed& seed, uint64_t n, PrgKind kind = best_prg_kind()) : n_(n), seed_(seed), prg_(seed, kind) {
+    unsigned bits = 0;
+    while (bits < 64 && (uint64_t(1) << bits) < n) {
+      ++bits;
+    }
+    half_bits_ = std::max(1u, (bits + 1) / 2);
+    half_mask_ = (uint64_t(1) << half_bits_) - 1;
+  }
+
+  uint64_t size() const { return n_; }
+  unsigned half_bits() const { return half_bits_; }
+  // The key: (seed, kind, n) rebuild the same permutations on the other side
+  const PrgSeed& seed() const { return seed_; }
+  PrgKind kind() const { return prg_.kind(); }
+
+  // pi_j(x) by direct PRG evaluation, for the receiver's t lookups
+  uint64_t permute(uint64_t j, uint64_t x) const {
+    do {
+      uint64_t left = x >> half_bits_;
+      uint64_t right = x & half_mask_;
+      for (unsigned r = 0; r < kRounds; ++r) {
+        uint64_t f;
+        prg_.fill(j, (uint64_t(r) << half_bits_) | right, &f, 1);
+        uint64_t next = left ^ (f & half_mask_);
+        left = right;
+        right = next;
+      }
+      x = (left << half_bits_) | right;
+    } while (x >= n_);
+    return x;
+  }
+
+  // Round function table of pi_j: entry (r << h) | R is F_r(R)
+  size_t table_size() const { return size_t(kRounds) << half_bits_; }
+
+  void tabulate(uint64_t j, uint32_t* table) const {
+    const size_t batch = 256;
+    uint64_t buf[batch];
+    for (size_t begin = 0; begin < table_size(); begin += batch) {
+      size_t len = std::min(batch, table_size() - begin);
+      prg_.fill(j, begin, buf, len);
+      for (size_t i = 0; i < len; ++i) {
+        table[begin + i] = uint32_t(buf[i] & half_mask_);
+      }
+    }
+  }
+
+  // pi_j(x) from the table written by tabulate(j, table)
+  uint64_t permute(const uint32_t* table, uint64_t x) const {
+    do {
+      uint64_t left = x >> half_bits_;
+      uint64_t right = x & half_mask_;
+      for (unsigned r = 0; r < kRounds; ++r) {
+        uint64_t next = left ^ table[(size_t(r) << half_bits_) | right];
+        left = right;
+        right = next;
+      }
+      x = (left << half_bits_) | right;
+    } while (x >= n_);
+    return x;
+  }
+
+  // pi_j^-1(y) from the same table: the rounds run backwards, and cycle walking goes back
+  // along the cycle until it lands in [0, n)
+  uint64_t unpermute(const uint32_t* table, uint64_t y) const {
+    do {
+      uint64_t left = y >> half_bits_;
+      uint64_t right = y & half_mask_;
+      for (unsigned r = kRounds; r-- > 0;) {
+        uint64_t prev = right ^ table[(size_t(r) << half_bits_) | left];
+        right = left;
+        left = prev;
+      }
+      y = (left << half_bits_) | right;
+    } while (y >= n_);
+    return y;
+  }
+
+private:
+  uint64_t n_;
+  unsigned half_bits_;
+  uint64_t half_mask_;
+  PrgSeed seed_;
+  Prg prg_;
+};
+
+// Sender-side expansion of a PRP query: the round tables of count invocations, filled in
+// parallel. positions() and sources() have the same shape as in PermutationSet, so GenRes
+// scatters (and the streaming GenRes gathers) with either query form.
+class PrpPositions {
+public:
+  PrpPositions(const FeistelPrp& prp, size_t count, ThreadPool& pool = ThreadPool::global())
+      : prp_(prp), tables_(count, prp.table_size()) {
+    tabulate(pool);
+  }
+
+  // Refills the tables in place, after the FeistelPrp they were built from has been given a
+  // new key over the same n
+  void tabulate(ThreadPool& pool = ThreadPool::global()) {
+    pool.parallel_for(0, tables_.rows(), 1, [&](size_t lo, size_t hi) {
+      for (size_t j = lo; j < hi; ++j) {
+        prp_.tabulate(j, tables_[j]);
+      }
+    });
+  }
+
+  size_t count() const { return tables_.rows(); }
+  size_t n() const { return size_t(prp_.size()); }
+
+  // Positions of messages [begin, begin + len) of invocation j, computed into scratch
+  const int* positions(size_t j, size_t begin, size_t len, int* scratch) const {
+    const uint32_t* table = tables_[j];
+    for (size_t i = 0; i < len; ++i) {
+      scratch[i] = int(prp_.permute(table, begin + i));
+    }
+    return scratch;
+  }
+
+  // Messages that land on positions [begin, begin + len) of invocation j, into scratch
+  const int* sources(size_t j, size_t begin, size_t len, int* scratch) const {
+    const uint32_t* table = tables_[j];
+    for (size_t i = 0; i < len; ++i) {
+      scratch[i] = int(prp_.unpermute(table, begin + i));
+    }
+    return scratch;
+  }
+
+private:
+  const FeistelPrp& prp_;
+  FlatMatrix<uint32_t> tables_;
+};
+
+#endif
@@ -0,0 +1,134 @@
+#ifndef OT_COMMON_SPSC_RING_H
+#define OT_COMMON_SPSC_RING_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <thread>
+#include <vector>
+#include "flat_buffer.h"
+
+// Bounded lock-free ring of fixed-size chunks between one producer thread and one consumer
+// thread, for streaming the sender's response into the receiver's filter: the producer
+// writes a chunk into the slot returned by acquire() and publishes it, the consumer reads
+// it from front() and pops it. Memory is slots x slot_len elements however long the stream
+// is. Each side waits by spinning briefly and then yielding, so neither takes a lock.
+//
+// A chunk is tagged with the invocation (row) it belongs to and its range of output
+// positions [begin, begin + len).
+struct RingChunk {
+  size_t row;
+  size_t begin;
+  size_t len;
+};
+
+// Defaults for response streaming: slots of 64 KB, eight of them
+const size_t kRingSlotBytes = 64 * 1024;
+const size_t kRingSlots = 8;
+
+// Elements per slot for rows of n messages of message_bytes each: a power of two (so that a
+// TBCS slot gathers from one aligned block of sources) and no larger than n
+inline size_t ring_slot_len(size_t n, size_t message_bytes) {
+  size_t len = 1;
+  while (len * 2 <= n && len * 2 * message_bytes <= kRingSlotBytes) {
+    len *= 2;
+  }
+  return len;
+}
+
+template <typename T>
+class SpscRing {
+public:
+  // slots is rounded up to a power of two
+  SpscRing(size_t slots, size_t slot_len) : mask_(0), slot_len_(slot_len), head_(0), tail_(0), closed_(false) {
+    size_t capacity = 1;
+    while (capacity < slots) {
+      capacity *= 2;
+    }
+    mask_ = capacity - 1;
+    data_.resize(capacity, slot_len);
+    tags_.resize(capacity);
+    cached_tail_ = 0;
+    cached_head_ = 0;
+  }
+
+  size_t slots() const { return mask_ + 1; }
+  size_t slot_len() const { return slot_len_; }
+
+  // Producer: the next free slot, waiting while the ring is full
+  T* acquire() {
+    const size_t head = head_.load(std::memory_order_relaxed);
+    for (unsigned spin = 0; head - cached_tail_ > mask_; ++spin) {
+      cached_tail_ = tail_.load(std::memory_order_acquire);
+      if (head - cached_tail_ > mask_) {
+        pause(spin);
+      }
+    }
+    return data_[head & mask_];
+  }
+
+  // Producer: hands the slot from acquire() to the consumer
+  void publish(const RingChunk& chunk) {
+    const size_t head = head_.load(std::memory_order_relaxed);
+    tags_[head & mask_] = chunk;
+    head_.store(head + 1, std::memory_order_release);
+  }
+
+  // Producer: no more chunks follow
+  void close() { closed_.store(true, std::memory_order_release); }
+
+  // Consumer: the oldest published chunk, waiting until there is one; nullptr once the
+  // producer has closed the ring and every chunk has been popped
+  const T* front(RingChunk& chunk) {
+    const size_t tail = tail_.load(std::memory_order_relaxed);
+    for (unsigned spin = 0; tail == cached_head_; ++spin) {
+      // Read closed_ first: a chunk published before close() is then seen by the reload
+      bool closed = closed_.load(std::memory_order_acquire);
+      cached_head_ = head_.load(std::memory_order_acquire);
+      if (tail == cached_head_) {
+        if (closed) {
+          return nullptr;
+        }
+        pause(spin);
+      }
+    }
+    chunk = tags_[tail & mask_];
+    return data_[tail & mask_];
+  }
+
+  // Consumer: releases the slot from front() to the producer
+  void pop() { tail_.store(tail_.load(std::memory_order_relaxed) + 1, std::memory_order_release); }
+
+private:
+  static void pause(unsigned spin) {
+    if (spin >= 64) {
+      std::this_thread::yield();
+    }
+  }
+
+  SpscRing(const SpscRing&);
+  SpscRing& operator=(const SpscRing&);
+
+  size_t mask_;
+  size_t slot_len_;
+  FlatMatrix<T> data_;
+  std::vector<RingChunk> tags_;
+  // Each index is written by one side only; they sit on separate cache lines together with
+  // that side's cached copy of the other index
+  alignas(64) std::atomic<size_t> head_;
+  size_t cached_tail_;  // producer's view of tail_
+  alignas(64) std::atomic<size_t> tail_;
+  size_t cached_head_;  // consumer's view of head_
+  alignas(64) std::atomic<bool> closed_;
+};
+
+// Runs produce() on a thread of its own and consume() on the caller, and returns when both
+// are done
+template <typename Produce, typename Consume>
+void run_pipeline(const Produce& produce, const Consume& consume) {
+  std::thread producer(produce);
+  consume();
+  producer.join();
+}
+
+#endif
@@ -0,0 +1,161 @@
+#ifndef OT_COMMON_TBCS_H
+#define OT_COMMON_TBCS_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+#include "block.h"
+#include "xor_kernel.h"
+
+// TBCS (tree of controlled swaps) engine. Level h of the tree swaps the two halves of every
+// group of 2^(e-h) leaves when b[h] == 1, i.e. it flips bit (e-1-h) of each leaf index.
+// All levels together therefore move leaf i to position i ^ mask, where mask is b read in
+// reverse bit order. Since i -> i ^ mask is an involution, the whole tree is applied as
+// one pass of pairwise swaps, done as swap_ranges/memcpy of runs of 2^ctz(mask) leaves.
+
+// log2 of a power-of-two database size
+inline int tbcs_depth(size_t n) {
+  int e = 0;
+  while ((size_t(1) << e) < n) {
+    ++e;
+  }
+  return e;
+}
+
+// Packs the controlled-swap bits b (b[0] = root level) into the index mask.
+// Returns false if b does not have log2(n) entries.
+inline bool tbcs_mask(size_t n, const std::vector<int>& b, uint64_t& mask) {
+  int e = tbcs_depth(n);
+  if (b.size() != size_t(e)) {
+    std::cerr << "\n Error: The length of bit-string b must be log2(length of m)." << std::endl;
+    return false;
+  }
+  mask = 0;
+  for (int h = 0; h < e; ++h) {
+    mask |= uint64_t(b[h] & 1) << (e - 1 - h);
+  }
+  return true;
+}
+
+// Length of the contiguous runs that stay together under i -> i ^ mask
+inline size_t tbcs_run(size_t n, uint64_t mask) {
+  if (mask == 0) {
+    return n;
+  }
+  size_t run = 1;
+  while ((mask & run) == 0) {
+    run <<= 1;
+  }
+  return run;
+}
+
+// Position that ends up at index pos after the swaps: O(1) once the mask is known, so
+// the receiver never materialises the permuted vector just to read one element
+inline size_t tbcs_select(size_t pos, uint64_t mask) {
+  return pos ^ mask;
+}
+
+// In-place permutation of the n leaves at tree
+template <typename T>
+void tbcs_permute(T* tree, size_t n, uint64_t mask) {
+  if (mask == 0) {
+    return;
+  }
+  size_t run = tbcs_run(n, mask);
+  for (size_t i = 0; i < n; i += run) {
+    size_t j = i ^ mask;
+    if (i < j) {
+      std::swap_ranges(tree + i, tree + i + run, tree + j);
+    }
+  }
+}
+
+// Fused mask-and-permute for the sender over output positions [lo, hi):
+// dst[i - lo] = m[i ^ mask] ^ pad[i ^ mask], so dst is a whole row at lo or a chunk buffer.
+// Long runs go through the batch XOR kernel, short ones are XORed inline.
+template <unsigned Bits>
+void tbcs_xor_gather(Block<Bits>* dst, const Block<Bits>* m, const Block<Bits>* pad, size_t lo, size_t hi, uint64_t mask) {
+  if (mask == 0) {
+    xor_blocks(dst, m + lo, pad + lo, hi - lo);
+    return;
+  }
+  size_t run = tbcs_run(hi, mask);
+  if (run >= 4) {
+    for (size_t i = lo; i < hi;) {
+      size_t len = std::min(run - (i & (run - 1)), hi - i);
+      size_t src = i ^ mask;
+      xor_blocks(dst + (i - lo), m + src, pad + src, len);
+      i += len;
+    }
+  } else {
+    for (size_t i = lo; i < hi; ++i) {
+      size_t src = i ^ mask;
+      dst[i - lo] = m[src] ^ pad[src];
+    }
+  }
+}
+
+// tbcs_xor_gather with a run length of Run blocks fixed at compile time: every run is XORed
+// with a constant trip count, which the compiler unrolls instead of calling the batch kernel
+// for a handful of blocks. lo and hi must be multiples of Run.
+template <size_t Run, unsigned Bits>
+void tbcs_xor_gather_runs(Block<Bits>* dst, const Block<Bits>* m, const Block<Bits>* pad, size_t lo, size_t hi, uint64_t mask) {
+  for (size_t i = lo; i < hi; i += Run) {
+    const size_t src = i ^ mask;
+    for (size_t k = 0; k < Run; ++k) {
+      dst[i - lo + k] = m[src + k] ^ pad[src + k];
+    }
+  }
+}
+
+// tbcs_xor_gather for n = 2^LogN known at compile time. Whole rows of up to 16 messages are
+// one fully unrolled loop; otherwise runs of up to 8 blocks (masks with one of their three
+// low bits set) take a fixed-stride copy, and longer runs the batch XOR kernel as before.
+template <int LogN, unsigned Bits>
+void tbcs_xor_gather_fixed(Block<Bits>* dst, const Block<Bits>* m, const Block<Bits>* pad, size_t lo, size_t hi, uint64_t mask) {
+  const size_t n = size_t(1) << LogN;
+  if (LogN <= 4 && lo == 0 && hi == n) {
+    for (size_t i = 0; i < n; ++i) {
+      dst[i] = m[i ^ mask] ^ pad[i ^ mask];
+    }
+    return;
+  }
+  const size_t run = tbcs_run(n, mask);
+  if (run <= 8 && ((lo | hi) & (run - 1)) == 0) {
+    switch (run) {
+      case 1: tbcs_xor_gather_runs<1>(dst, m, pad, lo, hi, mask); return;
+      case 2: tbcs_xor_gather_runs<2>(dst, m, pad, lo, hi, mask); return;
+      case 4: tbcs_xor_gather_runs<4>(dst, m, pad, lo, hi, mask); return;
+      case 8: tbcs_xor_gather_runs<8>(dst, m, pad, lo, hi, mask); return;
+    }
+  }
+  tbcs_xor_gather(dst, m, pad, lo, hi, mask);
+}
+
+// Streaming form of tbcs_xor_gather for pads that are produced on demand:
+// expand(src, out, len) writes pads [src, src + len). Output positions [lo, hi) are handled in
+// aligned power-of-two pieces of up to scratch_len; the sources of such a piece form one
+// aligned piece too, so each is expanded and masked contiguously in scratch and then
+// permuted into dst (which points at output position lo).
+template <unsigned Bits, typename Expand>
+void tbcs_xor_gather(Block<Bits>* dst, const Block<Bits>* m, const Expand& expand, size_t lo, size_t hi, uint64_t mask,
+                     Block<Bits>* scratch, size_t scratch_len) {
+  size_t piece = 1;
+  while (piece * 2 <= scratch_len && piece * 2 <= hi - lo && (lo & (piece * 2 - 1)) == 0) {
+    piece *= 2;
+  }
+  const uint64_t low = mask & (piece - 1);
+  for (size_t a = lo; a < hi; a += piece) {
+    size_t src = a ^ (mask & ~uint64_t(piece - 1));
+    expand(src, scratch, piece);
+    xor_blocks(scratch, m + src, scratch, piece);
+    size_t run = tbcs_run(piece, low);
+    for (size_t k = 0; k < piece; k += run) {
+      std::copy(scratch + (k ^ low), scratch + (k ^ low) + run, dst + (a - lo) + k);
+    }
+  }
+}
+
+#endif
@@ -0,0 +1,190 @@
+#ifndef OT_COMMON_THREAD_POOL_H
+#define OT_COMMON_THREAD_POOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Work-stealing pool for data-parallel loops. Each thread owns a task queue: it pops its
+// own work from the back and, once that runs dry, steals from the front of the others.
+// The thread calling parallel_for executes tasks too, so a pool of size 1 runs everything
+// inline on the caller.
+class ThreadPool {
+public:
+  // Most threads OT_THREADS can ask for
+  static const unsigned kMaxThreads = 1024;
+
+  // threads includes the caller; 0 picks hardware_concurrency
+  explicit ThreadPool(unsigned threads = 0) : pending_(0), stop_(false) {
+    if (threads == 0) {
+      threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    for (unsigned i = 0; i < threads; ++i) {
+      queues_.push_back(std::unique_ptr<Queue>(new Queue()));
+    }
+    // queue 0 belongs to the callers of parallel_for
+    for (unsigned i = 1; i < threads; ++i) {
+      workers_.push_back(std::thread(&ThreadPool::worker_loop, this, i));
+    }
+  }
+
+  ~ThreadPool() {
+    {
+      std::lock_guard<std::mutex> guard(wake_lock_);
+      stop_ = true;
+    }
+    wake_.notify_all();
+    for (size_t i = 0; i < workers_.size(); ++i) {
+      workers_[i].join();
+    }
+  }
+
+  unsigned size() const { return unsigned(queues_.size()); }
+
+  // Runs body(lo, hi) over [begin, end) cut into chunks of at least grain iterations
+  template <typename F>
+  void parallel_for(size_t begin, size_t end, size_t grain, const F& body) {
+    if (end <= begin) {
+      return;
+    }
+    size_t total = end - begin;
+    grain = std::max<size_t>(grain, 1);
+    if (size() == 1 || total <= grain) {
+      body(begin, end);
+      return;
+    }
+    // a few chunks per thread so stealing can even out uneven chunks
+    size_t chunks = std::min((total + grain - 1) / grain, size_t(size()) * 4);
+    size_t step = (total + chunks - 1) / chunks;
+    chunks = (total + step - 1) / step;
+    std::atomic<size_t> remaining(chunks);
+    for (size_t c = 0; c < chunks; ++c) {
+      Task task;
+      task.run = &invoke<F>;
+      task.body = &body;
+      task.lo = begin + c * step;
+      task.hi = std::min(end, task.lo + step);
+      task.remaining = &remaining;
+      push(c % size(), task);
+    }
+    {
+      // taking the lock orders the pushes before any sleeping worker re-checks pending_
+      std::lock_guard<std::mutex> guard(wake_lock_);
+    }
+    wake_.notify_all();
+    while (remaining.load(std::memory_order_acquire) != 0) {
+      if (!run_one(0)) {
+        std::this_thread::yield();
+      }
+    }
+  }
+
+  // Process-wide pool; OT_THREADS overrides the thread count
+  static ThreadPool& global() {
+    static ThreadPool pool(env_threads());
+    return pool;
+  }
+
+  // OT_THREADS, clamped to kMaxThreads; unset, non-numeric or <= 0 gives 0 (hardware_concurrency)
+  static unsigned env_threads() {
+    const char* value = getenv("OT_THREADS");
+    if (value == nullptr) {
+      return 0;
+    }
+    char* end = nullptr;
+    const long threads = strtol(value, &end, 10);
+    if (end == value || *end != '\0' || threads <= 0) {
+      return 0;
+    }
+    return unsigned(std::min<long>(threads, kMaxThreads));
+  }
+
+private:
+  struct Task {
+    void (*run)(const void* body, size_t lo, size_t hi);
+    const void* body;
+    size_t lo;
+    size_t hi;
+    std::atomic<size_t>* remaining;
+  };
+
+  // Owner pushes and pops at the back, thieves take from head; storage is reused
+  struct Queue {
+    std::mutex lock;
+    std::vector<Task> tasks;
+    size_t head = 0;
+  };
+
+  template <typename F>
+  static void invoke(const void* body, size_t lo, size_t hi) {
+    (*static_cast<const F*>(body))(lo, hi);
+  }
+
+  void push(size_t q, const Task& task) {
+    std::lock_guard<std::mutex> guard(queues_[q]->lock);
+    queues_[q]->tasks.push_back(task);
+    pending_.fetch_add(1, std::memory_order_release);
+  }
+
+  bool pop(size_t q, bool steal, Task& task) {
+    Queue& queue = *queues_[q];
+    std::lock_guard<std::mutex> guard(queue.lock);
+    if (queue.head == queue.tasks.size()) {
+      return false;
+    }
+    if (steal) {
+      task = queue.tasks[queue.head++];
+    } else {
+      task = queue.tasks.back();
+      queue.tasks.pop_back();
+    }
+    if (queue.head == queue.tasks.size()) {
+      queue.tasks.clear();
+      queue.head = 0;
+    }
+    pending_.fetch_sub(1, std::memory_order_relaxed);
+    return true;
+  }
+
+  bool run_one(size_t self) {
+    Task task;
+    bool found = pop(self, false, task);
+    for (size_t k = 1; !found && k < queues_.size(); ++k) {
+      found = pop((self + k) % queues_.size(), true, task);
+    }
+    if (!found) {
+      return false;
+    }
+    task.run(task.body, task.lo, task.hi);
+    task.remaining->fetch_sub(1, std::memory_order_acq_rel);
+    return true;
+  }
+
+  void worker_loop(size_t self) {
+    for (;;) {
+      if (run_one(self)) {
+        continue;
+      }
+      std::unique_lock<std::mutex> guard(wake_lock_);
+      wake_.wait(guard, [this] { return stop_ || pending_.load(std::memory_order_acquire) != 0; });
+      if (stop_) {
+        return;
+      }
+    }
+  }
+
+  std::vector<std::unique_ptr<Queue> > queues_;
+  std::vector<std::thread> workers_;
+  std::atomic<size_t> pending_;
+  std::mutex wake_lock_;
+  std::condition_variable wake_;
+  bool stop_;
+};
+
+#endif
@@ -0,0 +1,391 @@
+#ifndef OT_COMMON_TRACE_H
+#define OT_COMMON_TRACE_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <deque>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// Instrumentation of the phases and their inner kernels. Code marks a region with
+// OT_TRACE_SCOPE(kind, bytes); in a build with OT_TRACE defined (cmake -DOT_TRACE=ON) the
+// region adds one call, its bytes and its wall time to counters of the calling thread, and,
+// while a trace is being recorded, one span to the thread's event buffer. Kernels that run
+// back to back inside one loop use OT_TRACE_LAPS / OT_TRACE_LAP instead, one timestamp per
+// kernel rather than two. Without OT_TRACE the macros expand to nothing and their arguments
+// are not evaluated.
+//
+// Timestamps are the TSC on x86 (constant-rate on any CPU with constant_tsc), steady_clock
+// elsewhere, and are converted to nanoseconds against steady_clock when read.
+//
+// Counters are per thread and written by their thread only (relaxed loads and stores, no
+// locked instructions); totals are summed over threads when read, and a reset only moves the
+// reader's baseline, so it is safe while other threads are still tracing. Scopes sit at chunk
+// granularity (a scan chunk, a 1024-message stage, a PRG fill), never per message. Spans are
+// exported in the Chrome trace-event format (chrome://tracing, Perfetto).
+
+enum TraceKind {
+  // Phases
+  kTraceSetup,
+  kTraceGenQuery,
+  kTraceGenRes,
+  kTraceFilter,
+  kTraceRetrieve,
+  // Kernels inside them
+  kTracePrg,      // pad expansion
+  kTraceTbcs,     // Helix: masking and TBCS permutation of m, fused
+  kTraceMask,     // Priority: m ^ r
+  kTraceScatter,  // Priority: masked messages to their permuted positions
+  kTraceGather,   // filter and retrieval: the positions a receiver reads
+  kTraceKindCount
+};
+
+inline const char* trace_name(int kind) {
+  static const char* const names[kTraceKindCount] = {"Setup", "GenQuery", "GenRes", "OblFilter", "Retrieve",
+                                                     "prg",   "tbcs",     "mask",   "scatter",   "gather"};
+  return names[kind];
+}
+
+inline bool trace_is_phase(int kind) { return kind < kTracePrg; }
+
+#ifdef OT_TRACE
+const bool kTraceCompiled = true;
+#else
+const bool kTraceCompiled = false;
+#endif
+
+inline uint64_t trace_ticks() {
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+#endif
+}
+
+struct TraceEvent {
+  uint64_t start;     // ticks
+  uint64_t duration;  // ticks
+  uint64_t bytes;
+  uint32_t kind;
+};
+
+// Counters and span buffer of one thread. Only the thread writes them; the registry reads
+// them at any time and keeps its own baseline, so a reset never writes to a thread that may
+// still be running (an offline pool's producer, say). Kept by the registry after the thread
+// exits, so its counts still reach the totals.
+struct TraceThread {
+  std::atomic<uint64_t> calls[kTraceKindCount];
+  std::atomic<uint64_t> bytes[kTraceKindCount];
+  std::atomic<uint64_t> ticks[kTraceKindCount];
+  std::atomic<uint64_t> dropped;       // spans that did not fit in the buffer
+  std::atomic<TraceEvent*> events;     // allocated by the thread on its first recorded span
+  std::atomic<size_t> size;            // spans written, published after each write
+  std::unique_ptr<TraceEvent[]> storage;
+  size_t capacity;
+  uint32_t id;
+
+  // Registry side: counts at the last reset
+  uint64_t base_calls[kTraceKindCount];
+  uint64_t base_bytes[kTraceKindCount];
+  uint64_t base_ticks[kTraceKindCount];
+  uint64_t base_dropped;
+  size_t base_size;
+
+  explicit TraceThread(uint32_t id) : dropped(0), events(nullptr), size(0), capacity(0), id(id), base_dropped(0), base_size(0) {
+    for (int k = 0; k < kTraceKindCount; ++k) {
+      calls[k].store(0, std::memory_order_relaxed);
+      bytes[k].store(0, std::memory_order_relaxed);
+      ticks[k].store(0, std::memory_order_relaxed);
+      base_calls[k] = base_bytes[k] = base_ticks[k] = 0;
+    }
+  }
+
+  // Single writer: a plain load and store, no read-modify-write
+  static void bump(std::atomic<uint64_t>& counter, uint64_t by) {
+    counter.store(counter.load(std::memory_order_relaxed) + by, std::memory_order_relaxed);
+  }
+};
+
+struct TraceTotals {
+  uint64_t calls[kTraceKindCount];
+  uint64_t bytes[kTraceKindCount];
+  uint64_t ns[kTraceKindCount];
+  uint64_t dropped;
+};
+
+class TraceRegistry {
+public:
+  static TraceRegistry& global() {
+    static TraceRegistry registry;
+    return registry;
+  }
+
+  // The calling thread's counters, registered on first use
+  TraceThread& local() {
+    static thread_local TraceThread* thread = nullptr;
+    if (thread == nullptr) {
+      std::lock_guard<std::mutex> guard(lock_);
+      threads_.push_back(std::unique_ptr<TraceThread>(new TraceThread(uint32_t(threads_.size()))));
+      thread = threads_.back().get();
+    }
+    return *thread;
+  }
+
+  // Nanoseconds per tick, measured against steady_clock since the registry was created
+  double ns_per_tick() const {
+    const uint64_t ticks = trace_ticks() - epoch_ticks_;
+    const double ns = double(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch_).count());
+    return ticks > 0 ? ns / double(ticks) : 1.0;
+  }
+
+  bool recording() const { return recording_.load(std::memory_order_relaxed); }
+
+  // One region of the calling thread: counted, and kept as a span while recording
+  void record(int kind, uint64_t bytes, uint64_t start, uint64_t end) {
+    TraceThread& thread = local();
+    count(thread, kind, 1, bytes, end - start);
+    if (recording()) {
+      span(thread, kind, bytes, start, end);
+    }
+  }
+
+  static void count(TraceThread& thread, int kind, uint64_t calls, uint64_t bytes, uint64_t ticks) {
+    TraceThread::bump(thread.calls[kind], calls);
+    TraceThread::bump(thread.bytes[kind], bytes);
+    TraceThread::bump(thread.ticks[kind], ticks);
+  }
+
+  void span(TraceThread& thread, int kind, uint64_t bytes, uint64_t start, uint64_t end) {
+    TraceEvent* events = thread.events.load(std::memory_order_relaxed);
+    if (events == nullptr) {
+      // once per thread: the buffer never grows after this
+      thread.capacity = capacity_.load(std::memory_order_relaxed);
+      thread.storage.reset(new TraceEvent[thread.capacity]);
+      events = thread.storage.get();
+      thread.events.store(events, std::memory_order_release);
+    }
+    const size_t size = thread.size.load(std::memory_order_relaxed);
+    if (size < thread.capacity) {
+      TraceEvent event = {start, end - start, bytes, uint32_t(kind)};
+      events[size] = event;
+      thread.size.store(size + 1, std::memory_order_release);
+    } else {
+      TraceThread::bump(thread.dropped, 1);
+    }
+  }
+
+  // Starts keeping spans, up to capacity per thread (fixed by a thread's first span)
+  void start(size_t capacity) {
+    capacity_.store(capacity, std::memory_order_relaxed);
+    recording_.store(true, std::memory_order_relaxed);
+  }
+
+  void stop() { recording_.store(false, std::memory_order_relaxed); }
+
+  // Counters and spans from here on only
+  void reset() {
+    std::lock_guard<std::mutex> guard(lock_);
+    for (size_t t = 0; t < threads_.size(); ++t) {
+      TraceThread& thread = *threads_[t];
+      for (int k = 0; k < kTraceKindCount; ++k) {
+        thread.base_calls[k] = thread.calls[k].load(std::memory_order_relaxed);
+        thread.base_bytes[k] = thread.bytes[k].load(std::memory_order_relaxed);
+        thread.base_ticks[k] = thread.ticks[k].load(std::memory_order_relaxed);
+      }
+      thread.base_dropped = thread.dropped.load(std::memory_order_relaxed);
+      thread.base_size = thread.size.load(std::memory_order_acquire);
+    }
+  }
+
+  TraceTotals totals() const {
+    TraceTotals totals = {{0}, {0}, {0}, 0};
+    const double scale = ns_per_tick();
+    std::lock_guard<std::mutex> guard(lock_);
+    for (size_t t = 0; t < threads_.size(); ++t) {
+      const TraceThread& thread = *threads_[t];
+      for (int k = 0; k < kTraceKindCount; ++k) {
+        totals.calls[k] += thread.calls[k].load(std::memory_order_relaxed) - thread.base_calls[k];
+        totals.bytes[k] += thread.bytes[k].load(std::memory_order_relaxed) - thread.base_bytes[k];
+        totals.ns[k] += uint64_t((thread.ticks[k].load(std::memory_order_relaxed) - thread.base_ticks[k]) * scale);
+      }
+      totals.dropped += thread.dropped.load(std::memory_order_relaxed) - thread.base_dropped;
+    }
+    return totals;
+  }
+
+  // Chrome trace-event JSON: one complete event ("ph": "X") per span, timestamps in us
+  void write_json(std::ostream& out) const {
+    const double scale = ns_per_tick();
+    std::lock_guard<std::mutex> guard(lock_);
+    const long pid = long(getpid());
+    out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+    bool first = true;
+    out << std::fixed << std::setprecision(3);
+    for (size_t t = 0; t < threads_.size(); ++t) {
+      const TraceThread& thread = *threads_[t];
+      const TraceEvent* events = thread.events.load(std::memory_order_acquire);
+      const size_t size = thread.size.load(std::memory_order_acquire);
+      if (events == nullptr || size <= thread.base_size) {
+        continue;
+      }
+      out << (first ? "\n" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" << pid
+          << ",\"tid\":" << thread.id << ",\"args\":{\"name\":\"thread " << thread.id << "\"}}";
+      first = false;
+      for (size_t e = thread.base_size; e < size; ++e) {
+        const TraceEvent& event = events[e];
+        out << ",\n{\"name\":\"" << trace_name(event.kind) << "\",\"cat\":\""
+            << (trace_is_phase(event.kind) ? "phase" : "kernel") << "\",\"ph\":\"X\",\"ts\":"
+            << double(event.start - epoch_ticks_) * scale / 1e3 << ",\"dur\":" << double(event.duration) * scale / 1e3
+            << ",\"pid\":" << pid
+            << ",\"tid\":" << thread.id << ",\"args\":{\"bytes\":" << event.bytes << "}}";
+      }
+    }
+    out << "\n]}" << std::endl;
+    out.unsetf(std::ios::floatfield);
+    out << std::setprecision(6);
+  }
+
+private:
+  TraceRegistry() : epoch_(std::chrono::steady_clock::now()), epoch_ticks_(trace_ticks()), recording_(false), capacity_(0) {}
+
+  TraceRegistry(const TraceRegistry&);
+  TraceRegistry& operator=(const TraceRegistry&);
+
+  const std::chrono::steady_clock::time_point epoch_;
+  const uint64_t epoch_ticks_;
+  std::atomic<bool> recording_;
+  std::atomic<size_t> capacity_;
+  mutable std::mutex lock_;
+  std::deque<std::unique_ptr<TraceThread> > threads_;
+};
+
+// One region: counted, and kept as a span while recording
+class TraceScope {
+public:
+  TraceScope(int kind, uint64_t bytes) : kind_(kind), bytes_(bytes), start_(trace_ticks()) {}
+  ~TraceScope() { TraceRegistry::global().record(kind_, bytes_, start_, trace_ticks()); }
+
+private:
+  TraceScope(const TraceScope&);
+  TraceScope& operator=(const TraceScope&);
+
+  int kind_;
+  uint64_t bytes_;
+  uint64_t start_;
+};
+
+// Kernels run one after another: lap(kind, bytes) ends the kernel that ran since the previous
+// lap (or since construction). Counts stay local and reach the thread's counters once, when
+// the laps go out of scope.
+class TraceLaps {
+public:
+  TraceLaps() : thread_(TraceRegistry::global().local()), last_(trace_ticks()) {
+    for (int k = 0; k < kTraceKindCount; ++k) {
+      calls_[k] = bytes_[k] = ticks_[k] = 0;
+    }
+  }
+
+  ~TraceLaps() {
+    for (int k = 0; k < kTraceKindCount; ++k) {
+      if (calls_[k] > 0) {
+        TraceRegistry::count(thread_, k, calls_[k], bytes_[k], ticks_[k]);
+      }
+    }
+  }
+
+  void lap(int kind, uint64_t bytes) {
+    const uint64_t now = trace_ticks();
+    ++calls_[kind];
+    bytes_[kind] += bytes;
+    ticks_[kind] += now - last_;
+    TraceRegistry& registry = TraceRegistry::global();
+    if (registry.recording()) {
+      registry.span(thread_, kind, bytes, last_, now);
+    }
+    last_ = now;
+  }
+
+private:
+  TraceLaps(const TraceLaps&);
+  TraceLaps& operator=(const TraceLaps&);
+
+  TraceThread& thread_;
+  uint64_t last_;
+  uint64_t calls_[kTraceKindCount];
+  uint64_t bytes_[kTraceKindCount];
+  uint64_t ticks_[kTraceKindCount];
+};
+
+#ifdef OT_TRACE
+#define OT_TRACE_CONCAT_(a, b) a##b
+#define OT_TRACE_CONCAT(a, b) OT_TRACE_CONCAT_(a, b)
+#define OT_TRACE_SCOPE(kind, bytes) TraceScope OT_TRACE_CONCAT(trace_scope_, __LINE__)((kind), uint64_t(bytes))
+#define OT_TRACE_LAPS(name) TraceLaps name
+#define OT_TRACE_LAP(name, kind, bytes) name.lap((kind), uint64_t(bytes))
+#else
+#define OT_TRACE_SCOPE(kind, bytes) ((void)0)
+#define OT_TRACE_LAPS(name) ((void)0)
+#define OT_TRACE_LAP(name, kind, bytes) ((void)0)
+#endif
+
+// Spans per thread kept by trace_start unless told otherwise: 32 MB of address space per
+// recording thread, touched only as spans are written
+const size_t kTraceDefaultCapacity = size_t(1) << 20;
+
+inline void trace_start(size_t capacity = kTraceDefaultCapacity) { TraceRegistry::global().start(capacity); }
+inline void trace_stop() { TraceRegistry::global().stop(); }
+inline void trace_reset() { TraceRegistry::global().reset(); }
+inline TraceTotals trace_totals() { return TraceRegistry::global().totals(); }
+
+inline bool trace_write_json(const std::string& path) {
+  std::ofstream out(path.c_str());
+  TraceRegistry::global().write_json(out);
+  if (!out) {
+    std::cerr << "\n ** Error: cannot write the trace to " << path << std::endl;
+    return false;
+  }
+  return true;
+}
+
+// Counter table: calls, bytes and time per phase and kernel, summed over threads, divided by
+// iterations. Kernel time on worker threads adds up, so a kernel can exceed its phase.
+inline void trace_report(std::ostream& out, size_t iterations = 1) {
+  if (!kTraceCompiled) {
+    return;
+  }
+  const TraceTotals totals = trace_totals();
+  const double per = double(iterations > 0 ? iterations : 1);
+  out << "\n Trace (per iteration, summed over threads)" << std::endl;
+  out << " " << std::left << std::setw(10) << "Region" << std::right << std::setw(12) << "calls" << std::setw(14)
+      << "MB" << std::setw(12) << "ms" << std::setw(10) << "GB/s" << std::setw(12) << "ns/call" << std::endl;
+  for (int k = 0; k < kTraceKindCount; ++k) {
+    if (totals.calls[k] == 0) {
+      continue;
+    }
+    out << " " << std::left << std::setw(10) << (trace_is_phase(k) ? "" : "  ") + std::string(trace_name(k))
+        << std::right << std::fixed << std::setprecision(1) << std::setw(12) << totals.calls[k] / per
+        << std::setprecision(3) << std::setw(14) << totals.bytes[k] / per / 1e6 << std::setprecision(4)
+        << std::setw(12) << totals.ns[k] / per / 1e6 << std::setprecision(2) << std::setw(10)
+        << (totals.ns[k] > 0 ? double(totals.bytes[k]) / double(totals.ns[k]) : 0.0) << std::setprecision(0)
+        << std::setw(12) << double(totals.ns[k]) / double(totals.calls[k]) << std::endl;
+  }
+  if (totals.dropped > 0) {
+    out << " " << totals.dropped << " spans did not fit in the trace buffers" << std::endl;
+  }
+  out.unsetf(std::ios::floatfield);
+  out << std::setprecision(6);
+}
+
+#endif
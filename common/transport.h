@@ -0,0 +1,275 @@
+#ifndef OT_COMMON_TRANSPORT_H
+#define OT_COMMON_TRANSPORT_H
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "wire.h"
+
+// Framed stream between the two parties over a Unix-domain or TCP socket. Endpoints are
+// written unix:<path> or tcp:<host>:<port>. Frames are sent with writev, so a large payload
+// (the response) goes from the caller's buffer to the socket without being copied into a
+// send buffer first, and received with read straight into the caller's buffer. Every byte
+// that crosses the socket, headers included, is counted.
+class Channel {
+public:
+  explicit Channel(int fd) : fd_(fd), sent_(0), received_(0) {}
+  ~Channel() {
+    if (fd_ >= 0) {
+      ::close(fd_);
+    }
+  }
+
+  bool is_open() const { return fd_ >= 0; }
+  uint64_t bytes_sent() const { return sent_; }
+  uint64_t bytes_received() const { return received_; }
+
+  // One frame whose payload is the concatenation of the count buffers of parts
+  bool send_frame(uint32_t type, const iovec* parts, size_t count) {
+    FrameHeader header;
+    header.type = type;
+    header.reserved = 0;
+    header.length = 0;
+    std::vector<iovec> iov(count + 1);
+    iov[0].iov_base = &header;
+    iov[0].iov_len = sizeof(header);
+    for (size_t k = 0; k < count; ++k) {
+      iov[k + 1] = parts[k];
+      header.length += parts[k].iov_len;
+    }
+    return write_all(iov.data(), iov.size());
+  }
+
+  bool send_frame(uint32_t type, const void* payload = nullptr, size_t length = 0) {
+    iovec part;
+    part.iov_base = const_cast<void*>(payload);
+    part.iov_len = length;
+    return send_frame(type, &part, length == 0 ? 0 : 1);
+  }
+
+  template <typename T>
+  bool send_pod(uint32_t type, const T& value) {
+    return send_frame(type, &value, sizeof(T));
+  }
+
+  bool recv_header(FrameHeader& header) { return recv_exact(&header, sizeof(header)); }
+
+  bool recv_exact(void* out, size_t length) {
+    uint8_t* dst = static_cast<uint8_t*>(out);
+    while (length > 0) {
+      ssize_t got = ::read(fd_, dst, length);
+      if (got < 0 && errno == EINTR) {
+        continue;
+      }
+      if (got <= 0) {
+        return false;
+      }
+      dst += got;
+      length -= size_t(got);
+      received_ += uint64_t(got);
+    }
+    return true;
+  }
+
+  // Payload of a frame whose header was just read. A payload longer than max_length (an Error
+  // frame: kWireMaxErrorBytes) is refused before anything is allocated or read for it.
+  bool recv_payload(const FrameHeader& header, uint64_t max_length, std::vector<uint8_t>& payload) {
+    if (header.type == kWireError) {
+      max_length = kWireMaxErrorBytes;
+    }
+    if (header.length > max_length) {
+      std::cerr << "\n ** Error: frame type " << header.type << " has " << header.length << " bytes, at most "
+                << max_length << " expected" << std::endl;
+      send_error("frame too long");
+      return false;
+    }
+    payload.resize(size_t(header.length));
+    return recv_exact(payload.data(), payload.size());
+  }
+
+  // Next frame, which must be of type expected and at most max_length bytes long; an Error
+  // frame from the peer is printed
+  bool recv_frame(uint32_t expected, std::vector<uint8_t>& payload, uint64_t max_length) {
+    FrameHeader header;
+    if (!recv_header(header) || !recv_payload(header, max_length, payload)) {
+      return false;
+    }
+    if (header.type == kWireError) {
+      std::cerr << "\n ** Error from peer: " << std::string(payload.begin(), payload.end()) << std::endl;
+      return false;
+    }
+    if (header.type != expected) {
+      std::cerr << "\n ** Error: expected frame type " << expected << ", got " << header.type << std::endl;
+      return false;
+    }
+    return true;
+  }
+
+  // Next frame into a POD; the payload length must match
+  template <typename T>
+  bool recv_pod(uint32_t expected, T& value) {
+    std::vector<uint8_t> payload;
+    if (!recv_frame(expected, payload, sizeof(T))) {
+      return false;
+    }
+    if (payload.size() != sizeof(T)) {
+      std::cerr << "\n ** Error: frame type " << expected << " has " << payload.size() << " bytes, expected "
+                << sizeof(T) << std::endl;
+      return false;
+    }
+    memcpy(&value, payload.data(), sizeof(T));
+    return true;
+  }
+
+  bool send_error(const std::string& message) { return send_frame(kWireError, message.data(), message.size()); }
+
+private:
+  bool write_all(iovec* iov, size_t count) {
+    while (count > 0) {
+      ssize_t put = ::writev(fd_, iov, int(std::min<size_t>(count, IOV_MAX)));
+      if (put < 0 && errno == EINTR) {
+        continue;
+      }
+      if (put < 0) {
+        return false;
+      }
+      sent_ += uint64_t(put);
+      // Skip what was written; a partial write leaves the rest of one buffer
+      size_t left = size_t(put);
+      while (count > 0 && left >= iov->iov_len) {
+        left -= iov->iov_len;
+        ++iov;
+        --count;
+      }
+      if (count > 0) {
+        iov->iov_base = static_cast<uint8_t*>(iov->iov_base) + left;
+        iov->iov_len -= left;
+      }
+    }
+    return true;
+  }
+
+  Channel(const Channel&);
+  Channel& operator=(const Channel&);
+
+  int fd_;
+  uint64_t sent_;
+  uint64_t received_;
+};
+
+// unix:<path> or tcp:<host>:<port> into a socket address; false on a malformed endpoint
+inline bool parse_endpoint(const std::string& spec, sockaddr_storage& addr, socklen_t& length) {
+  memset(&addr, 0, sizeof(addr));
+  if (spec.compare(0, 5, "unix:") == 0) {
+    std::string path = spec.substr(5);
+    sockaddr_un* un = reinterpret_cast<sockaddr_un*>(&addr);
+    if (path.empty() || path.size() >= sizeof(un->sun_path)) {
+      std::cerr << "\n ** Error: bad socket path in " << spec << std::endl;
+      return false;
+    }
+    un->sun_family = AF_UNIX;
+    memcpy(un->sun_path, path.c_str(), path.size() + 1);
+    length = socklen_t(sizeof(sockaddr_un));
+    return true;
+  }
+  if (spec.compare(0, 4, "tcp:") == 0) {
+    size_t colon = spec.rfind(':');
+    std::string host = spec.substr(4, colon - 4), port = spec.substr(colon + 1);
+    addrinfo hints, *found = nullptr;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    if (colon <= 4 || port.empty() || getaddrinfo(host.c_str(), port.c_str(), &hints, &found) != 0) {
+      std::cerr << "\n ** Error: cannot resolve " << spec << std::endl;
+      return false;
+    }
+    memcpy(&addr, found->ai_addr, found->ai_addrlen);
+    length = found->ai_addrlen;
+    freeaddrinfo(found);
+    return true;
+  }
+  std::cerr << "\n ** Error: endpoint must be unix:<path> or tcp:<host>:<port>, got " << spec << std::endl;
+  return false;
+}
+
+// Small frames (query, stats) must not wait for Nagle's algorithm
+inline void tune_socket(int fd, const sockaddr_storage& addr) {
+  if (addr.ss_family != AF_UNIX) {
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  }
+}
+
+// Listening socket for endpoint, or -1. A stale Unix socket file is replaced.
+inline int listen_endpoint(const std::string& spec) {
+  sockaddr_storage addr;
+  socklen_t length;
+  if (!parse_endpoint(spec, addr, length)) {
+    return -1;
+  }
+  int fd = socket(addr.ss_family, SOCK_STREAM, 0);
+  if (fd < 0) {
+    std::cerr << "\n ** Error: socket: " << strerror(errno) << std::endl;
+    return -1;
+  }
+  if (addr.ss_family == AF_UNIX) {
+    unlink(reinterpret_cast<sockaddr_un*>(&addr)->sun_path);
+  } else {
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  }
+  if (bind(fd, reinterpret_cast<sockaddr*>(&addr), length) != 0 || listen(fd, 4) != 0) {
+    std::cerr << "\n ** Error: cannot listen on " << spec << ": " << strerror(errno) << std::endl;
+    ::close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+// Next connection on a listening socket, or -1
+inline int accept_endpoint(int listen_fd) {
+  sockaddr_storage addr;
+  socklen_t length = sizeof(addr);
+  int fd;
+  do {
+    fd = accept(listen_fd, reinterpret_cast<sockaddr*>(&addr), &length);
+  } while (fd < 0 && errno == EINTR);
+  if (fd >= 0) {
+    tune_socket(fd, addr);
+  }
+  return fd;
+}
+
+// Connected socket to endpoint, or -1
+inline int connect_endpoint(const std::string& spec) {
+  sockaddr_storage addr;
+  socklen_t length;
+  if (!parse_endpoint(spec, addr, length)) {
+    return -1;
+  }
+  int fd = socket(addr.ss_family, SOCK_STREAM, 0);
+  if (fd < 0 || connect(fd, reinterpret_cast<sockaddr*>(&addr), length) != 0) {
+    std::cerr << "\n ** Error: cannot connect to " << spec << ": " << strerror(errno) << std::endl;
+    if (fd >= 0) {
+      ::close(fd);
+    }
+    return -1;
+  }
+  tune_socket(fd, addr);
+  return fd;
+}
+
+#endif
@@ -0,0 +1,227 @@
+#ifndef OT_COMMON_WIRE_H
+#define OT_COMMON_WIRE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include "block.h"
+#include "permutation.h"
+#include "prp.h"
+
+// Binary wire format between the receiver and the sender. Every message is one frame: a
+// 16-byte FrameHeader (type, payload length) followed by the payload. Integers are written in
+// host order, which is little-endian on every platform the PRG supports. Payloads:
+//
+//   Hello        WireHello: protocol, sizes, bit width, query form, PRG kind
+//   HelloAck     WireHelloAck: the sender's n and whether its messages come from a seed
+//   Setup        WireSetup: the pad seed of one batch; both parties expand the pads from it
+//   HelixQuery   share1: number_of_OT words of index_bytes(n) bytes each
+//   PermQuery    the inverse permutations: number_of_OT rows of n positions, index_bytes(n)
+//                bytes each (the sender never needs the forward rows)
+//   PrpQuery     WirePrpKey: seed and PRG kind of the FeistelPrp, n
+//   Response     number_of_OT x n blocks of Block<Bits>::kWords words, sent as-is from the
+//                response buffer and received straight into one
+//   Stats        WireStats: the sender's compute time for the batch
+//   Error        a message for the peer's log
+//   Bye          end of session
+//
+// Between the coordinator of a sharded sender and its workers (tools/ot_net serve --shards):
+//
+//   ShardHello    WireShardHello: the session, and the slice [begin, end) of m the worker serves;
+//                 answered with HelloAck
+//   Setup         as above; answered with Stats once the worker's slice of the pads is ready
+//   ShardQuery    Helix: the number_of_OT share1 words, 8 bytes each; Priority: empty
+//   ShardResponse number_of_OT x (end - begin) blocks, row j the worker's piece of invocation
+//                 j, followed by Stats
+//   Bye           end of the worker's session
+
+enum WireType {
+  kWireHello = 1,
+  kWireHelloAck,
+  kWireSetup,
+  kWireHelixQuery,
+  kWirePermQuery,
+  kWirePrpQuery,
+  kWireResponse,
+  kWireStats,
+  kWireError,
+  kWireBye,
+  kWireShardHello,
+  kWireShardQuery,
+  kWireShardResponse
+};
+
+enum WireProtocol { kWireHelix = 1, kWirePriority };
+enum WireQueryForm { kWireTbcs = 1, kWirePerm, kWirePrp };
+
+struct FrameHeader {
+  uint32_t type;
+  uint32_t reserved;
+  uint64_t length;
+};
+
+struct WireHello {
+  uint32_t protocol;
+  uint32_t query_form;
+  uint64_t n;
+  uint64_t number_of_OT;
+  uint64_t t;
+  uint32_t bits;
+  uint32_t prg_kind;
+  uint64_t message_seed; // messages of a sender without a database are expanded from this
+};
+
+struct WireHelloAck {
+  uint64_t n;
+  uint32_t ok;
+  uint32_t messages_from_seed;
+};
+
+struct WireShardHello {
+  uint32_t protocol;
+  uint32_t bits;
+  uint64_t n;
+  uint64_t number_of_OT;
+  uint64_t begin;
+  uint64_t end;
+  uint64_t message_seed;
+  uint32_t prg_kind;
+  uint32_t from_db;  // the worker serves its own copy of the database instead of seeded messages
+};
+
+struct WireSetup {
+  uint64_t pad_seed[2];
+};
+
+struct WirePrpKey {
+  uint64_t seed[2];
+  uint64_t n;
+  uint32_t prg_kind;
+  uint32_t reserved;
+};
+
+struct WireStats {
+  uint64_t setup_ns;
+  uint64_t decode_ns;  // query deserialization, not included in genres_ns
+  uint64_t genres_ns;
+};
+
+// Bytes per value in [0, n): the narrowest whole number of bytes
+inline unsigned index_bytes(uint64_t n) {
+  unsigned bytes = 1;
+  while (bytes < 8 && n > (uint64_t(1) << (8 * bytes))) {
+    ++bytes;
+  }
+  return bytes;
+}
+
+// Longest Error message a party reads
+const uint64_t kWireMaxErrorBytes = 4096;
+
+// Largest payload a frame of type can carry in a session of number_of_OT invocations over n
+// messages of bits bits (for the shard frames, n is the worker's slice). A party checks each
+// header against it before allocating for the payload; unknown types may carry nothing.
+inline uint64_t wire_max_payload(uint32_t type, uint64_t n, uint64_t number_of_OT, unsigned bits) {
+  switch (type) {
+    case kWireHello: return sizeof(WireHello);
+    case kWireHelloAck: return sizeof(WireHelloAck);
+    case kWireSetup: return sizeof(WireSetup);
+    case kWireHelixQuery: return number_of_OT * index_bytes(n);
+    case kWirePermQuery: return number_of_OT * n * index_bytes(n);
+    case kWirePrpQuery: return sizeof(WirePrpKey);
+    case kWireResponse: return number_of_OT * n * (bits / 8);
+    case kWireStats: return sizeof(WireStats);
+    case kWireError: return kWireMaxErrorBytes;
+    case kWireShardHello: return sizeof(WireShardHello);
+    case kWireShardQuery: return number_of_OT * sizeof(uint64_t);
+    case kWireShardResponse: return number_of_OT * n * (bits / 8);
+  }
+  return 0;
+}
+
+// Packs count values into width bytes each, appending to out
+template <typename T>
+void pack_values(const T* values, size_t count, unsigned width, std::vector<uint8_t>& out) {
+  size_t at = out.size();
+  out.resize(at + count * width);
+  uint8_t* dst = out.data() + at;
+  for (size_t i = 0; i < count; ++i) {
+    uint64_t v = uint64_t(values[i]);
+    memcpy(dst + i * width, &v, width);
+  }
+}
+
+template <typename T>
+void unpack_values(const uint8_t* src, size_t count, unsigned width, T* values) {
+  for (size_t i = 0; i < count; ++i) {
+    uint64_t v = 0;
+    memcpy(&v, src + i * width, width);
+    values[i] = T(v);
+  }
+}
+
+// Helix query: share1 of gen_query
+inline void serialize_shares(const std::vector<uint64_t>& shares, uint64_t n, std::vector<uint8_t>& out) {
+  out.clear();
+  pack_values(shares.data(), shares.size(), index_bytes(n), out);
+}
+
+inline bool deserialize_shares(const std::vector<uint8_t>& in, uint64_t n, size_t number_of_OT, std::vector<uint64_t>& shares) {
+  if (in.size() != number_of_OT * index_bytes(n)) {
+    return false;
+  }
+  shares.resize(number_of_OT);
+  unpack_values(in.data(), number_of_OT, index_bytes(n), shares.data());
+  return true;
+}
+
+// Priority query: the inverse rows of w
+inline void serialize_permutations(const PermutationSet& w, std::vector<uint8_t>& out) {
+  out.clear();
+  out.reserve(w.count() * w.n() * index_bytes(w.n()));
+  for (size_t j = 0; j < w.count(); ++j) {
+    pack_values(w.inverse(j), w.n(), index_bytes(w.n()), out);
+  }
+}
+
+inline bool deserialize_permutations(const std::vector<uint8_t>& in, uint64_t n, size_t number_of_OT, PermutationSet& w) {
+  const unsigned width = index_bytes(n);
+  if (in.size() != number_of_OT * n * width) {
+    return false;
+  }
+  w.resize(number_of_OT, n);
+  for (size_t j = 0; j < number_of_OT; ++j) {
+    unpack_values(in.data() + j * n * width, n, width, w.inverse(j));
+  }
+  return true;
+}
+
+inline WirePrpKey serialize_prp(const FeistelPrp& prp) {
+  WirePrpKey key;
+  memset(&key, 0, sizeof(key));
+  key.seed[0] = prp.seed().w[0];
+  key.seed[1] = prp.seed().w[1];
+  key.n = prp.size();
+  key.prg_kind = uint32_t(prp.kind());
+  return key;
+}
+
+inline PrgSeed wire_seed(const uint64_t words[2]) {
+  PrgSeed seed;
+  seed.w[0] = words[0];
+  seed.w[1] = words[1];
+  return seed;
+}
+
+// A peer's key is usable only if it permutes [0, n) and uses the PRG kind negotiated in the
+// hello; deserialize_prp aborts on a kind this CPU cannot run
+inline bool check_prp_key(const WirePrpKey& key, uint64_t n, uint32_t prg_kind) {
+  return key.n == n && key.prg_kind == prg_kind && prg_supported(PrgKind(key.prg_kind));
+}
+
+inline FeistelPrp deserialize_prp(const WirePrpKey& key) {
+  return FeistelPrp(wire_seed(key.seed), key.n, PrgKind(key.prg_kind));
+}
+
+#endif
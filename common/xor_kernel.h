@@ -0,0 +1,121 @@
+#ifndef OT_COMMON_XOR_KERNEL_H
+#define OT_COMMON_XOR_KERNEL_H
+
+#include <cstddef>
+#include <cstdint>
+#include "block.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define OT_XOR_X86 1
+#define OT_TARGET(isa) __attribute__((target(isa)))
+#endif
+
+// Batch XOR over contiguous 64-bit words: dst[k] = a[k] ^ b[k]. dst may alias a or b.
+// Every ISA path produces the same output as xor_words_scalar.
+
+enum XorIsa { kXorScalar = 0, kXorSse2, kXorAvx2, kXorAvx512, kXorIsaCount };
+
+typedef void (*XorWordsFn)(uint64_t* dst, const uint64_t* a, const uint64_t* b, size_t words);
+
+inline const char* xor_isa_name(XorIsa isa) {
+  static const char* names[kXorIsaCount] = {"scalar", "sse2", "avx2", "avx512"};
+  return names[isa];
+}
+
+inline void xor_words_scalar(uint64_t* dst, const uint64_t* a, const uint64_t* b, size_t words) {
+  for (size_t k = 0; k < words; ++k) {
+    dst[k] = a[k] ^ b[k];
+  }
+}
+
+#ifdef OT_XOR_X86
+OT_TARGET("sse2")
+inline void xor_words_sse2(uint64_t* dst, const uint64_t* a, const uint64_t* b, size_t words) {
+  size_t k = 0;
+  for (; k + 2 <= words; k += 2) {
+    __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + k));
+    __m128i y = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + k));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + k), _mm_xor_si128(x, y));
+  }
+  xor_words_scalar(dst + k, a + k, b + k, words - k);
+}
+
+OT_TARGET("avx2")
+inline void xor_words_avx2(uint64_t* dst, const uint64_t* a, const uint64_t* b, size_t words) {
+  size_t k = 0;
+  for (; k + 8 <= words; k += 8) {
+    __m256i x0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + k));
+    __m256i x1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + k + 4));
+    __m256i y0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + k));
+    __m256i y1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + k + 4));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + k), _mm256_xor_si256(x0, y0));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + k + 4), _mm256_xor_si256(x1, y1));
+  }
+  for (; k + 4 <= words; k += 4) {
+    __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + k));
+    __m256i y = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + k));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + k), _mm256_xor_si256(x, y));
+  }
+  xor_words_scalar(dst + k, a + k, b + k, words - k);
+}
+
+OT_TARGET("avx512f")
+inline void xor_words_avx512(uint64_t* dst, const uint64_t* a, const uint64_t* b, size_t words) {
+  size_t k = 0;
+  for (; k + 8 <= words; k += 8) {
+    __m512i x = _mm512_loadu_si512(a + k);
+    __m512i y = _mm512_loadu_si512(b + k);
+    _mm512_storeu_si512(dst + k, _mm512_xor_si512(x, y));
+  }
+  if (k < words) {
+    __mmask8 tail = static_cast<__mmask8>((1u << (words - k)) - 1);
+    __m512i x = _mm512_maskz_loadu_epi64(tail, a + k);
+    __m512i y = _mm512_maskz_loadu_epi64(tail, b + k);
+    _mm512_mask_storeu_epi64(dst + k, tail, _mm512_xor_si512(x, y));
+  }
+}
+#endif
+
+// Kernel for isa, or nullptr when this CPU (or build target) cannot run it
+inline XorWordsFn xor_words_kernel(XorIsa isa) {
+  switch (isa) {
+    case kXorScalar:
+      return xor_words_scalar;
+#ifdef OT_XOR_X86
+    case kXorSse2:
+      return __builtin_cpu_supports("sse2") ? xor_words_sse2 : nullptr;
+    case kXorAvx2:
+      return __builtin_cpu_supports("avx2") ? xor_words_avx2 : nullptr;
+    case kXorAvx512:
+      return __builtin_cpu_supports("avx512f") ? xor_words_avx512 : nullptr;
+#endif
+    default:
+      return nullptr;
+  }
+}
+
+// Widest ISA the running CPU supports
+inline XorIsa best_xor_isa() {
+  for (int isa = kXorIsaCount - 1; isa > kXorScalar; --isa) {
+    if (xor_words_kernel(static_cast<XorIsa>(isa)) != nullptr) {
+      return static_cast<XorIsa>(isa);
+    }
+  }
+  return kXorScalar;
+}
+
+// Runtime-dispatched batch XOR; CPU detection runs once per process
+inline void xor_words(uint64_t* dst, const uint64_t* a, const uint64_t* b, size_t words) {
+  static const XorWordsFn kernel = xor_words_kernel(best_xor_isa());
+  kernel(dst, a, b, words);
+}
+
+// dst[i] = a[i] ^ b[i] for count blocks laid out contiguously
+template <unsigned Bits>
+inline void xor_blocks(Block<Bits>* dst, const Block<Bits>* a, const Block<Bits>* b, size_t count) {
+  static_assert(sizeof(Block<Bits>) == Block<Bits>::kWords * sizeof(uint64_t), "Block must be padding-free");
+  xor_words(dst->w, a->w, b->w, count * Block<Bits>::kWords);
+}
+
+#endif
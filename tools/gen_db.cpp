@@ -0,0 +1,57 @@
+// Writes a test database of n random records of record_bits bits in the format read by
+// MappedDatabase (common/database.h). Records are expanded from seed with the pad PRG
+// (ChaCha20, so the same seed gives the same file on any machine).
+//
+//   g++ -std=c++11 -O2 gen_db.cpp -o gen_db -lgmpxx -lgmp
+//   ./gen_db messages.otdb 1048576 128 [seed]
+
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <cstdlib>
+#include "../common/database.h"
+#include "../common/prg.h"
+using namespace std;
+
+int main(int argc, char** argv) {
+  if (argc < 4) {
+    cerr << "usage: " << argv[0] << " <path> <n> <record_bits> [seed]" << endl;
+    return 1;
+  }
+  const char* path = argv[1];
+  uint64_t n = strtoull(argv[2], nullptr, 10);
+  uint64_t record_bits = strtoull(argv[3], nullptr, 10);
+  uint64_t seed = argc > 4 ? strtoull(argv[4], nullptr, 10) : 1;
+  if (n == 0 || record_bits == 0) {
+    cerr << "\n ** Error: n and record_bits must be positive" << endl;
+    return 1;
+  }
+  const size_t words = (record_bits + 63) / 64;
+  const uint64_t top = record_bits % 64 == 0 ? ~uint64_t(0) : (uint64_t(1) << (record_bits % 64)) - 1;
+
+  ofstream out(path, ios::binary | ios::trunc);
+  if (!out) {
+    cerr << "\n ** Error: cannot create " << path << endl;
+    return 1;
+  }
+  DatabaseHeader header = database_header(n, record_bits);
+  out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+  const Prg prg(prg_seed(seed), kPrgChaCha20);
+  const uint64_t batch = 65536; // records per write
+  vector<uint64_t> buf(batch * words);
+  for (uint64_t begin = 0; begin < n; begin += batch) {
+    uint64_t len = min(batch, n - begin);
+    prg.fill(0, begin * words, buf.data(), len * words);
+    for (uint64_t i = 0; i < len; ++i) {
+      buf[i * words + words - 1] &= top;
+    }
+    out.write(reinterpret_cast<const char*>(buf.data()), len * words * sizeof(uint64_t));
+  }
+  if (!out) {
+    cerr << "\n ** Error: failed writing " << path << endl;
+    return 1;
+  }
+  cout << "wrote " << n << " records of " << record_bits << " bits to " << path << endl;
+  return 0;
+}
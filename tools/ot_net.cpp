@@ -0,0 +1,1333 @@
+// Runs the sender and the receiver of Helix OT or Priority OT as two processes over a
+// Unix-domain socket or loopback TCP, with the messages of common/wire.h, and reports the
+// bytes each phase puts on the wire and the end-to-end latency next to the compute time.
+//
+//   cmake -S . -B build && cmake --build build --target ot_net
+//   ./build/ot_net serve unix:/tmp/ot.sock &
+//   ./build/ot_net query unix:/tmp/ot.sock --protocol priority --n 65536 --t 10 --batch 4 --query prp
+//
+// serve <endpoint> [options]     sender; answers one session after another
+//   --db PATH                    serve the records of a database (tools/gen_db) instead of
+//                                messages expanded from the receiver's message seed
+//   --sessions N                 exit after N sessions, default 0 (never)
+//   --shards K                   shard m over K local worker processes (see Sharded sender)
+//   --workers EP,EP,...          shard m over workers started with `shard`, in slice order
+//
+// shard <endpoint> [options]     worker of a sharded sender; serves one coordinator at a time
+//   --db PATH                    its copy of the coordinator's database
+//   --sessions N                 exit after N coordinators, default 0 (never)
+//
+// scale [options]                the single-process sender against the sharded one, in one
+//   --shards K,K,...             process with local workers, default 1,2,4; takes the query
+//                                options below except --db
+//
+// query <endpoint> [options]     receiver; runs reps batches and prints the report
+//   --protocol helix|priority    default helix
+//   --n N                        messages, default 4096; 0 takes the sender's database size
+//   --t N                        Priority OT choices per invocation, default 10
+//   --batch N                    invocations per batch, default 1
+//   --bits N                     64, 128, 256, 512 or 1024, default 128
+//   --query perm|prp             Priority OT query form, default perm
+//   --reps N                     timed batches, default 5
+//   --warmup N                   untimed batches first, default 1
+//   --seed N                     message seed, default 1
+//   --db PATH                    the sender's database, to check the retrieved records
+//
+// Per batch the receiver sends the pad seed (Setup), then the query; the sender runs Setup
+// as soon as the seed arrives, overlapping the receiver's own Setup, and answers the query
+// with the response and its compute times. Setup and GenRes in the report are the sender's
+// times; the other phases are the receiver's.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <gmpxx.h>
+#include "../Helix-OT--1-out-of-n-OT/helix_ot.h"
+#include "../Priority-OT--ordered-t-out-of-n-OT/priority_ot.h"
+#include "../common/database.h"
+#include "../common/phase_bench.h"
+#include "../common/transport.h"
+#include "../common/wire.h"
+using namespace std;
+
+typedef chrono::steady_clock Clock;
+
+inline uint64_t elapsed_ns(Clock::time_point since) {
+  return uint64_t(chrono::duration_cast<chrono::nanoseconds>(Clock::now() - since).count());
+}
+
+// Memory a sender lets one batch take: half of the machine's, as ot_suite's --max-gb default
+inline uint64_t batch_memory_limit() {
+  return uint64_t(sysconf(_SC_PHYS_PAGES)) * uint64_t(sysconf(_SC_PAGE_SIZE)) / 2;
+}
+
+inline bool supported_bits(uint32_t bits) {
+  return bits == 64 || bits == 128 || bits == 256 || bits == 512 || bits == 1024;
+}
+
+// Messages [begin, end) that both parties expand from the receiver's message seed when the
+// sender has no database. Message i is block i of PRG stream 0, so a shard seeks to its slice.
+template <unsigned Bits>
+BlockVector<Bits> seeded_messages(uint64_t seed, uint64_t begin, uint64_t end) {
+  BlockVector<Bits> m(end - begin);
+  Prg(prg_seed(seed)).fill_blocks<Bits>(0, begin, m.data(), m.size());
+  return m;
+}
+
+// ---------------------------------------------------------------------------------------------
+// Sharded sender
+//
+// serve --shards K spreads the sender over K local worker processes (--workers names workers
+// already running, here or on other machines). Worker k holds the contiguous slice [a, b) of m,
+// expands only its slice of the pads from the pad seed, and computes its slice of the response;
+// the coordinator holds no messages and only assembles the slices into the response frame.
+//
+// Helix: the slices are equal aligned blocks of L = n / K messages, K a power of two. TBCS
+// sends message i to i ^ mask, so an aligned block lands on the aligned block starting at
+// a ^ (mask & ~(L - 1)), and message a + i lands at offset i ^ (mask & (L - 1)) inside it: a
+// worker runs the ordinary Helix scan over its L messages with the masks cut to log2(L) bits,
+// and the coordinator receives row j of each worker straight into its place in the response.
+// Priority: a permutation scatters a slice anywhere, so a worker returns the masked messages
+// m[i] ^ r[j][i] of its slice in order and the coordinator scatters them through the query.
+
+typedef pair<uint64_t, uint64_t> Slice;
+
+// Slices of m for count workers; empty, with reason set, if the workers cannot split m
+vector<Slice> shard_slices(bool helix_protocol, uint64_t n, size_t count, string& reason) {
+  vector<Slice> slices;
+  if (count == 0 || count > n) {
+    reason = "more workers than messages";
+  } else if (helix_protocol && (count & (count - 1)) != 0) {
+    reason = "Helix OT needs a power-of-two number of workers";
+  } else {
+    for (size_t k = 0; k < count; ++k) {
+      slices.push_back(Slice(n * k / count, n * (k + 1) / count));
+    }
+  }
+  return slices;
+}
+
+// Worker: one coordinator session over m, the hello.end - hello.begin messages of its slice
+template <unsigned Bits>
+bool shard_session(Channel& channel, const WireShardHello& hello, const Block<Bits>* m) {
+  const size_t len = size_t(hello.end - hello.begin), number_of_OT = size_t(hello.number_of_OT);
+  BlockMatrix<Bits> pads, response;
+  vector<uint64_t> masks;
+  vector<uint8_t> payload;
+  bool ready = false;
+  WireStats stats = {0, 0, 0};
+  for (;;) {
+    FrameHeader header;
+    if (!channel.recv_header(header)) {
+      return false;
+    }
+    if (!channel.recv_payload(header, wire_max_payload(header.type, len, number_of_OT, Bits), payload)) {
+      return false;
+    }
+    if (header.type == kWireBye) {
+      return true;
+    }
+    Clock::time_point start = Clock::now();
+    if (header.type == kWireSetup && payload.size() == sizeof(WireSetup)) {
+      WireSetup setup;
+      memcpy(&setup, payload.data(), sizeof(setup));
+      // Row j of the pads is PRG stream j, so the slice starts at block hello.begin of it
+      const Prg prg(wire_seed(setup.pad_seed));
+      pads.resize(number_of_OT, len);
+      batch_for(ThreadPool::global(), number_of_OT, len, [&](size_t j, size_t lo, size_t hi) {
+        prg.fill_blocks(j, hello.begin + lo, pads[j] + lo, hi - lo);
+      });
+      ready = true;
+      stats.setup_ns = elapsed_ns(start);
+      if (!channel.send_pod(kWireStats, stats)) {
+        return false;
+      }
+      continue;
+    }
+    if (header.type != kWireShardQuery || !ready) {
+      channel.send_error("query before setup or unexpected frame");
+      return false;
+    }
+    if (hello.protocol == kWireHelix) {
+      if (payload.size() != number_of_OT * sizeof(uint64_t)) {
+        channel.send_error("malformed shard query");
+        return false;
+      }
+      masks.resize(number_of_OT);
+      memcpy(masks.data(), payload.data(), payload.size());
+      for (size_t j = 0; j < number_of_OT; ++j) {
+        masks[j] &= len - 1;
+      }
+      stats.decode_ns = elapsed_ns(start);
+      response = helix::gen_res_scan(m, int(number_of_OT), int(len), pads, masks);
+    } else {
+      stats.decode_ns = 0;
+      response.resize(number_of_OT, len);
+      batch_for(ThreadPool::global(), number_of_OT, len, [&](size_t j, size_t lo, size_t hi) {
+        xor_blocks(response[j] + lo, m + lo, pads[j] + lo, hi - lo);
+      });
+    }
+    // The pads are single-use: a Setup comes before every query
+    ready = false;
+    stats.genres_ns = elapsed_ns(start) - stats.decode_ns;
+    iovec part;
+    part.iov_base = response.data();
+    part.iov_len = response.rows() * response.cols() * sizeof(Block<Bits>);
+    if (!channel.send_frame(kWireShardResponse, &part, 1) || !channel.send_pod(kWireStats, stats)) {
+      return false;
+    }
+  }
+}
+
+template <unsigned Bits>
+bool shard_bits(Channel& channel, const WireShardHello& hello, const string& db_path) {
+  MappedDatabase<Bits> db;
+  BlockVector<Bits> m;
+  const Block<Bits>* slice = nullptr;
+  if (hello.begin >= hello.end || hello.end > hello.n || hello.n > uint64_t(1) << 30 || hello.number_of_OT == 0 ||
+      hello.number_of_OT > uint64_t(1) << 20 || hello.prg_kind != uint32_t(best_prg_kind()) ||
+      2 * (hello.end - hello.begin) * hello.number_of_OT * (Bits / 8) > batch_memory_limit()) {
+    channel.send_error("the worker cannot serve this slice");
+    return false;
+  }
+  if (hello.from_db) {
+    if (db_path.empty() || !db.open(db_path) || db.size() != hello.n) {
+      channel.send_error("the worker's database does not match the coordinator's");
+      return false;
+    }
+    slice = db.data() + hello.begin;
+  } else {
+    m = seeded_messages<Bits>(hello.message_seed, hello.begin, hello.end);
+    slice = m.data();
+  }
+  WireHelloAck ack = {hello.end - hello.begin, 1, hello.from_db ? 0u : 1u};
+  return channel.send_pod(kWireHelloAck, ack) && shard_session<Bits>(channel, hello, slice);
+}
+
+// Worker: the sessions of one coordinator connection, until the coordinator hangs up
+bool shard_connection(Channel& channel, const string& db_path) {
+  for (;;) {
+    FrameHeader header;
+    WireShardHello hello;
+    if (!channel.recv_header(header)) {
+      return true;
+    }
+    if (header.type != kWireShardHello || header.length != sizeof(hello) || !channel.recv_exact(&hello, sizeof(hello))) {
+      channel.send_error("expected a shard hello");
+      return false;
+    }
+    bool ok = false;
+    switch (hello.bits) {
+      case 64: ok = shard_bits<64>(channel, hello, db_path); break;
+      case 128: ok = shard_bits<128>(channel, hello, db_path); break;
+      case 256: ok = shard_bits<256>(channel, hello, db_path); break;
+      case 512: ok = shard_bits<512>(channel, hello, db_path); break;
+      case 1024: ok = shard_bits<1024>(channel, hello, db_path); break;
+      default: channel.send_error("supported widths are 64, 128, 256, 512, 1024");
+    }
+    if (!ok) {
+      return false;
+    }
+  }
+}
+
+// shard <endpoint | fd:N>: a worker listening on endpoint, or on a socket it inherited
+int shard(const string& endpoint, const string& db_path, int sessions) {
+  if (endpoint.compare(0, 3, "fd:") == 0) {
+    Channel channel(atoi(endpoint.c_str() + 3));
+    return shard_connection(channel, db_path) ? 0 : 1;
+  }
+  int listen_fd = listen_endpoint(endpoint);
+  if (listen_fd < 0) {
+    return 1;
+  }
+  cerr << "worker on " << endpoint << endl;
+  for (int s = 0; sessions == 0 || s < sessions; ++s) {
+    Channel channel(accept_endpoint(listen_fd));
+    if (!channel.is_open()) {
+      cerr << "\n ** Error: accept: " << strerror(errno) << endl;
+      break;
+    }
+    shard_connection(channel, db_path);
+  }
+  close(listen_fd);
+  return 0;
+}
+
+// Threads of each of count local workers: OT_THREADS as the pool reads it, else an even share
+// of the cores
+inline unsigned worker_threads(size_t count) {
+  const unsigned threads = ThreadPool::env_threads();
+  if (threads != 0) {
+    return threads;
+  }
+  return max(1u, thread::hardware_concurrency() / unsigned(max<size_t>(count, 1)));
+}
+
+// Coordinator's connections to its workers, and the worker processes it started
+class WorkerSet {
+public:
+  WorkerSet() : broken_(false) {}
+
+  ~WorkerSet() {
+    // Hanging up ends the workers we started
+    channels_.clear();
+    for (size_t k = 0; k < pids_.size(); ++k) {
+      waitpid(pids_[k], nullptr, 0);
+    }
+  }
+
+  // count workers running this program, each on one end of a socketpair; they share the
+  // cores evenly unless OT_THREADS is set. Each gets OT_THREADS=worker_threads(count), so
+  // they run exactly the thread count scale reports.
+  bool spawn(size_t count, const string& db_path) {
+    const unsigned threads = worker_threads(count);
+    // Everything the child needs is built before fork, which it follows with exec only
+    vector<string> env_strings;
+    for (char** e = environ; *e != nullptr; ++e) {
+      if (strncmp(*e, "OT_THREADS=", 11) != 0) {
+        env_strings.push_back(*e);
+      }
+    }
+    env_strings.push_back("OT_THREADS=" + to_string(threads));
+    vector<char*> env;
+    for (size_t i = 0; i < env_strings.size(); ++i) {
+      env.push_back(&env_strings[i][0]);
+    }
+    env.push_back(nullptr);
+    for (size_t k = 0; k < count; ++k) {
+      int sv[2];
+      if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv) != 0) {
+        cerr << "\n ** Error: socketpair: " << strerror(errno) << endl;
+        return false;
+      }
+      string self = "/proc/self/exe", mode = "shard", fd = "fd:" + to_string(sv[1]), db_flag = "--db", db = db_path;
+      vector<char*> args = {&self[0], &mode[0], &fd[0]};
+      if (!db.empty()) {
+        args.push_back(&db_flag[0]);
+        args.push_back(&db[0]);
+      }
+      args.push_back(nullptr);
+      pid_t pid = fork();
+      if (pid == 0) {
+        // The worker's end survives exec, the coordinator's does not
+        fcntl(sv[1], F_SETFD, 0);
+        execve(self.c_str(), args.data(), env.data());
+        _exit(127);
+      }
+      close(sv[1]);
+      if (pid < 0) {
+        cerr << "\n ** Error: fork: " << strerror(errno) << endl;
+        close(sv[0]);
+        return false;
+      }
+      pids_.push_back(pid);
+      channels_.push_back(unique_ptr<Channel>(new Channel(sv[0])));
+    }
+    return true;
+  }
+
+  // Workers started with `ot_net shard <endpoint>`, endpoints separated by commas
+  bool connect(const string& endpoints) {
+    size_t begin = 0;
+    while (begin <= endpoints.size()) {
+      size_t end = min(endpoints.find(',', begin), endpoints.size());
+      unique_ptr<Channel> channel(new Channel(connect_endpoint(endpoints.substr(begin, end - begin))));
+      if (!channel->is_open()) {
+        return false;
+      }
+      channels_.push_back(move(channel));
+      begin = end + 1;
+    }
+    return true;
+  }
+
+  size_t size() const { return channels_.size(); }
+  Channel& operator[](size_t k) { return *channels_[k]; }
+
+  // A worker failed mid-session; the connections can no longer be trusted
+  void mark_broken() { broken_ = true; }
+  bool broken() const { return broken_; }
+
+  uint64_t bytes_received() const {
+    uint64_t bytes = 0;
+    for (size_t k = 0; k < channels_.size(); ++k) {
+      bytes += channels_[k]->bytes_received();
+    }
+    return bytes;
+  }
+
+private:
+  WorkerSet(const WorkerSet&);
+  WorkerSet& operator=(const WorkerSet&);
+
+  vector<unique_ptr<Channel> > channels_;
+  vector<pid_t> pids_;
+  bool broken_;
+};
+
+// Coordinator: Setup and GenRes of one session, computed by the workers. The workers' stats
+// are folded into one WireStats, each time the slowest worker's.
+template <unsigned Bits>
+class ShardedSender {
+public:
+  explicit ShardedSender(WorkerSet& workers) : workers_(workers), helix_(true), n_(0), number_of_OT_(0), open_(false) {}
+
+  ~ShardedSender() { close(); }
+
+  // Starts the session on every worker; false, with reason set, if they cannot serve it
+  bool open(const WireShardHello& session, string& reason) {
+    helix_ = session.protocol == kWireHelix;
+    n_ = size_t(session.n);
+    number_of_OT_ = size_t(session.number_of_OT);
+    slices_ = shard_slices(helix_, session.n, workers_.size(), reason);
+    if (slices_.empty()) {
+      return false;
+    }
+    for (size_t k = 0; k < slices_.size(); ++k) {
+      WireShardHello hello = session;
+      hello.begin = slices_[k].first;
+      hello.end = slices_[k].second;
+      if (!workers_[k].send_pod(kWireShardHello, hello)) {
+        return fail(reason);
+      }
+    }
+    for (size_t k = 0; k < slices_.size(); ++k) {
+      WireHelloAck ack;
+      if (!workers_[k].recv_pod(kWireHelloAck, ack) || ack.n != slices_[k].second - slices_[k].first) {
+        return fail(reason);
+      }
+    }
+    staging_.resize(slices_.size());
+    scratch_.resize(slices_.size());
+    open_ = true;
+    return true;
+  }
+
+  // Phase 1: every worker expands its slice of the pads; returns once all have
+  bool setup(const PrgSeed& pad_seed, WireStats& stats) {
+    WireSetup setup = {{pad_seed.w[0], pad_seed.w[1]}};
+    for (size_t k = 0; k < slices_.size(); ++k) {
+      if (!workers_[k].send_pod(kWireSetup, setup)) {
+        return fail();
+      }
+    }
+    stats.setup_ns = 0;
+    for (size_t k = 0; k < slices_.size(); ++k) {
+      WireStats worker;
+      if (!workers_[k].recv_pod(kWireStats, worker)) {
+        return fail();
+      }
+      stats.setup_ns = max(stats.setup_ns, worker.setup_ns);
+    }
+    return true;
+  }
+
+  // Phase 3, Helix: row j of worker k goes straight to its destination block
+  bool respond(const vector<uint64_t>& share1, BlockMatrix<Bits>& response, WireStats& stats) {
+    if (share1.size() != number_of_OT_ || !helix::check_shares(int(n_), share1)) {
+      return false;
+    }
+    iovec part;
+    part.iov_base = const_cast<uint64_t*>(share1.data());
+    part.iov_len = share1.size() * sizeof(uint64_t);
+    response.resize(number_of_OT_, n_);
+    return gather(&part, 1, stats, [&](Channel& channel, size_t k, size_t j) {
+      const size_t begin = slices_[k].first, len = slices_[k].second - begin;
+      return channel.recv_exact(response[j] + (begin ^ (share1[j] & ~uint64_t(len - 1))), len * sizeof(Block<Bits>));
+    });
+  }
+
+  // Phase 3, Priority: w is a PermutationSet or PrpPositions; row j of worker k is scattered
+  // to the positions of its messages
+  template <typename Query>
+  bool respond(const Query& w, BlockMatrix<Bits>& response, WireStats& stats) {
+    if (!priority::check_query(w, int(number_of_OT_), n_)) {
+      return false;
+    }
+    response.resize(number_of_OT_, n_);
+    return gather(nullptr, 0, stats, [&](Channel& channel, size_t k, size_t j) {
+      const size_t begin = slices_[k].first, len = slices_[k].second - begin;
+      staging_[k].resize(len);
+      scratch_[k].resize(len);
+      if (!channel.recv_exact(staging_[k].data(), len * sizeof(Block<Bits>))) {
+        return false;
+      }
+      const int* pos = w.positions(j, begin, len, scratch_[k].data());
+      Block<Bits>* row = response[j];
+      for (size_t i = 0; i < len; ++i) {
+        row[pos[i]] = staging_[k][i];
+      }
+      return true;
+    });
+  }
+
+  // Ends the session on every worker
+  void close() {
+    if (open_) {
+      for (size_t k = 0; k < slices_.size(); ++k) {
+        workers_[k].send_frame(kWireBye);
+      }
+      open_ = false;
+    }
+  }
+
+private:
+  bool fail() {
+    workers_.mark_broken();
+    return false;
+  }
+
+  bool fail(string& reason) {
+    reason = "a worker refused the session";
+    return fail();
+  }
+
+  // Sends the query to every worker, then reads the workers' responses concurrently, row by
+  // row through place(channel, k, j); the slices are disjoint, so are the places they go to
+  template <typename Place>
+  bool gather(const iovec* query, size_t parts, WireStats& stats, const Place& place) {
+    for (size_t k = 0; k < slices_.size(); ++k) {
+      if (!workers_[k].send_frame(kWireShardQuery, query, parts)) {
+        return fail();
+      }
+    }
+    atomic<bool> ok(true);
+    vector<WireStats> worker(slices_.size());
+    ThreadPool::global().parallel_for(0, slices_.size(), 1, [&](size_t lo, size_t hi) {
+      for (size_t k = lo; k < hi; ++k) {
+        Channel& channel = workers_[k];
+        FrameHeader header;
+        const size_t bytes = number_of_OT_ * (slices_[k].second - slices_[k].first) * sizeof(Block<Bits>);
+        bool good = channel.recv_header(header) && header.type == kWireShardResponse && header.length == bytes;
+        for (size_t j = 0; good && j < number_of_OT_; ++j) {
+          good = place(channel, k, j);
+        }
+        if (!good || !channel.recv_pod(kWireStats, worker[k])) {
+          ok = false;
+        }
+      }
+    });
+    if (!ok) {
+      cerr << "\n ** Error: a worker failed to answer the query" << endl;
+      return fail();
+    }
+    stats.decode_ns = stats.genres_ns = 0;
+    for (size_t k = 0; k < worker.size(); ++k) {
+      stats.decode_ns = max(stats.decode_ns, worker[k].decode_ns);
+      stats.genres_ns = max(stats.genres_ns, worker[k].genres_ns);
+    }
+    return true;
+  }
+
+  WorkerSet& workers_;
+  bool helix_;
+  size_t n_;
+  size_t number_of_OT_;
+  bool open_;
+  vector<Slice> slices_;
+  vector<BlockVector<Bits> > staging_;
+  vector<vector<int> > scratch_;
+};
+
+// ---------------------------------------------------------------------------------------------
+// Sender
+
+// Why the sender refuses hello for n messages; empty if it does not
+string refuse(const WireHello& hello, uint64_t n) {
+  bool helix = hello.protocol == kWireHelix;
+  if (!helix && hello.protocol != kWirePriority) {
+    return "unknown protocol";
+  }
+  if (helix ? hello.query_form != kWireTbcs : (hello.query_form != kWirePerm && hello.query_form != kWirePrp)) {
+    return "query form does not match the protocol";
+  }
+  if (n == 0 || n > uint64_t(1) << 30 || hello.number_of_OT == 0 || hello.number_of_OT > uint64_t(1) << 20) {
+    return "n or the batch size is out of range";
+  }
+  if (helix && (n & (n - 1)) != 0) {
+    return "Helix OT needs n to be a power of two";
+  }
+  // The pads and the response, number_of_OT x n blocks each; both bounds above keep this in range
+  const uint64_t batch_bytes = 2 * n * hello.number_of_OT * (hello.bits / 8);
+  if (batch_bytes > batch_memory_limit()) {
+    return "a batch of " + to_string(hello.number_of_OT) + " x " + to_string(n) + " messages needs " +
+           to_string(batch_bytes >> 20) + " MB, more than the sender allows";
+  }
+  // Both parties expand the pads with their default PRG, so it must be the same one
+  if (hello.prg_kind != uint32_t(best_prg_kind())) {
+    return string("PRG mismatch: the sender expands pads with ") + prg_name(best_prg_kind());
+  }
+  return "";
+}
+
+// One session over the messages m (a BlockVector or a MappedDatabase)
+template <unsigned Bits, typename Database>
+bool serve_session(Channel& channel, const WireHello& hello, const Database& m) {
+  typedef BlockMessages<Bits> Messages;
+  const int n = int(m.size()), number_of_OT = int(hello.number_of_OT);
+  unique_ptr<helix::Sender<Messages> > helix_sender;
+  unique_ptr<priority::Sender<Messages> > priority_sender;
+  vector<uint8_t> payload;
+  vector<uint64_t> share1;
+  PermutationSet w;
+  BlockMatrix<Bits> response;
+  WireStats stats = {0, 0, 0};
+  for (;;) {
+    FrameHeader header;
+    if (!channel.recv_header(header)) {
+      return false;
+    }
+    if (!channel.recv_payload(header, wire_max_payload(header.type, n, number_of_OT, Bits), payload)) {
+      return false;
+    }
+    if (header.type == kWireBye) {
+      return true;
+    }
+    Clock::time_point start = Clock::now();
+    if (header.type == kWireSetup) {
+      WireSetup setup;
+      if (payload.size() != sizeof(setup)) {
+        channel.send_error("malformed setup");
+        return false;
+      }
+      memcpy(&setup, payload.data(), sizeof(setup));
+      PrgSeed pad_seed = wire_seed(setup.pad_seed);
+      if (hello.protocol == kWireHelix) {
+        helix_sender.reset(new helix::Sender<Messages>(n, number_of_OT, Bits, pad_seed));
+        helix_sender->setup();
+      } else {
+        priority_sender.reset(new priority::Sender<Messages>(n, number_of_OT, Bits, pad_seed));
+        priority_sender->setup();
+      }
+      stats.setup_ns = elapsed_ns(start);
+      continue;
+    }
+    if (!helix_sender && !priority_sender) {
+      channel.send_error("query before setup");
+      return false;
+    }
+    bool decoded = false;
+    if (header.type == kWireHelixQuery && helix_sender) {
+      decoded = deserialize_shares(payload, n, number_of_OT, share1);
+      stats.decode_ns = elapsed_ns(start);
+      if (decoded) {
+        response = helix_sender->respond(m, share1);
+      }
+    } else if (header.type == kWirePermQuery && priority_sender) {
+      decoded = deserialize_permutations(payload, n, number_of_OT, w);
+      stats.decode_ns = elapsed_ns(start);
+      if (decoded) {
+        response = priority_sender->respond(m, w);
+      }
+    } else if (header.type == kWirePrpQuery && priority_sender && payload.size() == sizeof(WirePrpKey)) {
+      WirePrpKey key;
+      memcpy(&key, payload.data(), sizeof(key));
+      decoded = check_prp_key(key, n, hello.prg_kind);
+      if (decoded) {
+        FeistelPrp prp = deserialize_prp(key);
+        stats.decode_ns = elapsed_ns(start);
+        response = priority_sender->respond(m, prp);
+      }
+    }
+    stats.genres_ns = elapsed_ns(start) - stats.decode_ns;
+    if (!decoded || response.rows() != size_t(number_of_OT) || response.cols() != size_t(n)) {
+      channel.send_error("malformed or invalid query");
+      return false;
+    }
+    // The response goes to the socket straight from its buffer
+    iovec part;
+    part.iov_base = response.data();
+    part.iov_len = response.rows() * response.cols() * sizeof(Block<Bits>);
+    if (!channel.send_frame(kWireResponse, &part, 1) || !channel.send_pod(kWireStats, stats)) {
+      return false;
+    }
+  }
+}
+
+// One session of a sharded sender: the workers compute Setup and GenRes, the coordinator
+// decodes the query and assembles the response
+template <unsigned Bits>
+bool serve_sharded(Channel& channel, const WireHello& hello, const WireHelloAck& ack, WorkerSet& workers) {
+  const size_t n = size_t(ack.n), number_of_OT = size_t(hello.number_of_OT);
+  WireShardHello session = {hello.protocol, Bits, ack.n, hello.number_of_OT, 0, 0, hello.message_seed, hello.prg_kind,
+                            ack.messages_from_seed ? 0u : 1u};
+  ShardedSender<Bits> sharded(workers);
+  string reason;
+  if (!sharded.open(session, reason)) {
+    channel.send_error(reason);
+    return false;
+  }
+  if (!channel.send_pod(kWireHelloAck, ack)) {
+    return false;
+  }
+  vector<uint8_t> payload;
+  vector<uint64_t> share1;
+  PermutationSet w;
+  BlockMatrix<Bits> response;
+  WireStats stats = {0, 0, 0};
+  bool set_up = false;
+  for (;;) {
+    FrameHeader header;
+    if (!channel.recv_header(header)) {
+      return false;
+    }
+    if (!channel.recv_payload(header, wire_max_payload(header.type, n, number_of_OT, Bits), payload)) {
+      return false;
+    }
+    if (header.type == kWireBye) {
+      return true;
+    }
+    Clock::time_point start = Clock::now();
+    if (header.type == kWireSetup) {
+      WireSetup setup;
+      if (payload.size() != sizeof(setup)) {
+        channel.send_error("malformed setup");
+        return false;
+      }
+      memcpy(&setup, payload.data(), sizeof(setup));
+      if (!sharded.setup(wire_seed(setup.pad_seed), stats)) {
+        channel.send_error("a worker failed in setup");
+        return false;
+      }
+      set_up = true;
+      continue;
+    }
+    if (!set_up) {
+      channel.send_error("query before setup");
+      return false;
+    }
+    set_up = false;
+    WireStats worker = {0, 0, 0};
+    bool answered = false;
+    if (header.type == kWireHelixQuery && hello.protocol == kWireHelix) {
+      answered = deserialize_shares(payload, n, number_of_OT, share1);
+      stats.decode_ns = elapsed_ns(start);
+      answered = answered && sharded.respond(share1, response, worker);
+    } else if (header.type == kWirePermQuery && hello.protocol == kWirePriority) {
+      answered = deserialize_permutations(payload, n, number_of_OT, w);
+      stats.decode_ns = elapsed_ns(start);
+      answered = answered && sharded.respond(w, response, worker);
+    } else if (header.type == kWirePrpQuery && hello.protocol == kWirePriority && payload.size() == sizeof(WirePrpKey)) {
+      WirePrpKey key;
+      memcpy(&key, payload.data(), sizeof(key));
+      if (check_prp_key(key, n, hello.prg_kind)) {
+        FeistelPrp prp = deserialize_prp(key);
+        PrpPositions positions(prp, number_of_OT);
+        stats.decode_ns = elapsed_ns(start);
+        answered = sharded.respond(positions, response, worker);
+      }
+    }
+    // GenRes is the coordinator's wall time from decoded query to assembled response
+    stats.genres_ns = elapsed_ns(start) - stats.decode_ns;
+    if (!answered) {
+      channel.send_error(workers.broken() ? "a worker failed in GenRes" : "malformed or invalid query");
+      return false;
+    }
+    iovec part;
+    part.iov_base = response.data();
+    part.iov_len = response.rows() * response.cols() * sizeof(Block<Bits>);
+    if (!channel.send_frame(kWireResponse, &part, 1) || !channel.send_pod(kWireStats, stats)) {
+      return false;
+    }
+  }
+}
+
+template <unsigned Bits>
+bool serve_bits(Channel& channel, const WireHello& hello, const string& db_path, WorkerSet* workers) {
+  WireHelloAck ack = {0, 1, db_path.empty() ? 1u : 0u};
+  MappedDatabase<Bits> db;
+  BlockVector<Bits> m;
+  if (!db_path.empty()) {
+    if (!db.open(db_path)) {
+      channel.send_error("the sender's database does not hold " + to_string(Bits) + "-bit records");
+      return false;
+    }
+    ack.n = db.size();
+    if (hello.n != 0 && hello.n != ack.n) {
+      channel.send_error("the sender's database holds " + to_string(ack.n) + " records");
+      return false;
+    }
+  } else {
+    ack.n = hello.n;
+  }
+  string reason = refuse(hello, ack.n);
+  if (!reason.empty()) {
+    channel.send_error(reason);
+    return false;
+  }
+  if (workers != nullptr) {
+    return serve_sharded<Bits>(channel, hello, ack, *workers);
+  }
+  if (db_path.empty()) {
+    m = seeded_messages<Bits>(hello.message_seed, 0, ack.n);
+  }
+  if (!channel.send_pod(kWireHelloAck, ack)) {
+    return false;
+  }
+  return db_path.empty() ? serve_session<Bits>(channel, hello, m) : serve_session<Bits>(channel, hello, db);
+}
+
+// workers is null for a single-process sender
+int serve(const string& endpoint, const string& db_path, int sessions, WorkerSet* workers) {
+  int listen_fd = listen_endpoint(endpoint);
+  if (listen_fd < 0) {
+    return 1;
+  }
+  cerr << "serving on " << endpoint << endl;
+  for (int s = 0; sessions == 0 || s < sessions; ++s) {
+    Channel channel(accept_endpoint(listen_fd));
+    if (!channel.is_open()) {
+      cerr << "\n ** Error: accept: " << strerror(errno) << endl;
+      break;
+    }
+    WireHello hello;
+    if (!channel.recv_pod(kWireHello, hello)) {
+      continue;
+    }
+    bool ok = false;
+    switch (hello.bits) {
+      case 64: ok = serve_bits<64>(channel, hello, db_path, workers); break;
+      case 128: ok = serve_bits<128>(channel, hello, db_path, workers); break;
+      case 256: ok = serve_bits<256>(channel, hello, db_path, workers); break;
+      case 512: ok = serve_bits<512>(channel, hello, db_path, workers); break;
+      case 1024: ok = serve_bits<1024>(channel, hello, db_path, workers); break;
+      default: channel.send_error("supported widths are 64, 128, 256, 512, 1024");
+    }
+    cerr << "session " << s << (ok ? " done" : " aborted") << ": " << channel.bytes_received() << " bytes in, "
+         << channel.bytes_sent() << " bytes out" << endl;
+    if (workers != nullptr && workers->broken()) {
+      cerr << "\n ** Error: lost a worker; stopping" << endl;
+      break;
+    }
+  }
+  close(listen_fd);
+  return 0;
+}
+
+// ---------------------------------------------------------------------------------------------
+// Receiver
+
+struct QueryOptions {
+  string protocol;
+  uint64_t n;
+  int t;
+  int batch;
+  unsigned bits;
+  string query;
+  int reps;
+  int warmup;
+  uint64_t seed;
+  string db;
+};
+
+// Per-batch communication and latency, next to the PhaseBench compute times
+struct NetReport {
+  uint64_t n;                         // messages, as acknowledged by the sender
+  uint64_t phase_bytes[kPhaseCount];  // bytes the phase put on the wire, one batch
+  vector<double> round_trip_ns;       // query sent .. response received
+  vector<double> transfer_ns;         // round trip minus the sender's decode and GenRes
+  vector<double> end_to_end_ns;       // GenQuery start .. Retrieve end
+  vector<double> decode_ns;           // sender's query decoding
+};
+
+template <unsigned Bits>
+bool query_bits(Channel& channel, const QueryOptions& o, PhaseBench& bench, NetReport& net) {
+  typedef BlockMessages<Bits> Messages;
+  const bool helix_protocol = o.protocol == "helix";
+  WireHello hello;
+  memset(&hello, 0, sizeof(hello));
+  hello.protocol = helix_protocol ? kWireHelix : kWirePriority;
+  hello.query_form = helix_protocol ? kWireTbcs : o.query == "prp" ? kWirePrp : kWirePerm;
+  hello.n = o.n;
+  hello.number_of_OT = uint64_t(o.batch);
+  hello.t = helix_protocol ? 1 : uint64_t(o.t);
+  hello.bits = Bits;
+  hello.prg_kind = uint32_t(best_prg_kind());
+  hello.message_seed = o.seed;
+  WireHelloAck ack;
+  if (!channel.send_pod(kWireHello, hello) || !channel.recv_pod(kWireHelloAck, ack)) {
+    return false;
+  }
+  const int n = int(ack.n), number_of_OT = o.batch;
+  net.n = ack.n;
+  if (!helix_protocol && (o.t <= 0 || o.t > n)) {
+    cerr << "\n ** Error: t must be in [1, " << n << "]" << endl;
+    return false;
+  }
+
+  // What the sender holds, to check the retrieved messages against
+  BlockVector<Bits> seeded;
+  MappedDatabase<Bits> db;
+  const Block<Bits>* expected = nullptr;
+  if (ack.messages_from_seed) {
+    seeded = seeded_messages<Bits>(o.seed, 0, ack.n);
+    expected = seeded.data();
+  } else if (!o.db.empty() && db.open(o.db) && db.size() == ack.n) {
+    expected = db.data();
+  } else {
+    cerr << "the sender serves a database; pass --db to check the retrieved records" << endl;
+  }
+
+  vector<int> indices;
+  vector<vector<int> > p;
+  if (helix_protocol) {
+    indices = helix::generateRandomIntegers(number_of_OT, n - 1);
+  } else {
+    p = priority::generateRandomVectors(o.t, number_of_OT, n);
+  }
+  vector<uint8_t> payload;
+  BlockMatrix<Bits> response;
+  typename Messages::vector_type out;
+  for (int rep = 0; rep < bench.total_iterations(); ++rep) {
+    PrgSeed pad_seed = random_prg_seed();
+    WireSetup setup = {{pad_seed.w[0], pad_seed.w[1]}};
+    uint64_t sent = channel.bytes_sent();
+    if (!channel.send_pod(kWireSetup, setup)) {
+      return false;
+    }
+    net.phase_bytes[kPhaseSetup] = channel.bytes_sent() - sent;
+    unique_ptr<helix::Receiver<Messages> > helix_receiver;
+    unique_ptr<priority::Receiver<Messages> > priority_receiver;
+    if (helix_protocol) {
+      helix_receiver.reset(new helix::Receiver<Messages>(n, number_of_OT, Bits, pad_seed));
+      helix_receiver->setup();
+    } else {
+      priority_receiver.reset(new priority::Receiver<Messages>(n, number_of_OT, o.t, Bits, pad_seed));
+      priority_receiver->setup();
+    }
+
+    bench.begin();
+    Clock::time_point start = Clock::now();
+    uint32_t type;
+    WirePrpKey key;
+    if (helix_protocol) {
+      serialize_shares(helix_receiver->query(indices), n, payload);
+      type = kWireHelixQuery;
+    } else if (o.query == "prp") {
+      key = serialize_prp(priority_receiver->query_prp(p));
+      payload.assign(reinterpret_cast<const uint8_t*>(&key), reinterpret_cast<const uint8_t*>(&key + 1));
+      type = kWirePrpQuery;
+    } else {
+      serialize_permutations(priority_receiver->query(p), payload);
+      type = kWirePermQuery;
+    }
+    bench.lap(kPhaseGenQuery);
+
+    Clock::time_point sent_at = Clock::now();
+    sent = channel.bytes_sent();
+    if (!channel.send_frame(type, payload.data(), payload.size())) {
+      return false;
+    }
+    net.phase_bytes[kPhaseGenQuery] = channel.bytes_sent() - sent;
+    uint64_t received = channel.bytes_received();
+    FrameHeader header;
+    if (!channel.recv_header(header)) {
+      return false;
+    }
+    const size_t response_bytes = size_t(number_of_OT) * n * sizeof(Block<Bits>);
+    if (header.type != kWireResponse || header.length != response_bytes) {
+      if (header.type == kWireError && channel.recv_payload(header, kWireMaxErrorBytes, payload)) {
+        cerr << "\n ** Error from peer: " << string(payload.begin(), payload.end()) << endl;
+      } else {
+        cerr << "\n ** Error: unexpected frame " << header.type << " of " << header.length << " bytes" << endl;
+      }
+      return false;
+    }
+    // Received straight into the response matrix
+    response.resize(number_of_OT, n);
+    if (!channel.recv_exact(response.data(), response_bytes)) {
+      return false;
+    }
+    double round_trip = double(elapsed_ns(sent_at));
+    net.phase_bytes[kPhaseGenRes] = channel.bytes_received() - received;
+    WireStats stats;
+    if (!channel.recv_pod(kWireStats, stats)) {
+      return false;
+    }
+    bench.mark();
+    bench.record(kPhaseSetup, double(stats.setup_ns));
+    bench.record(kPhaseGenRes, double(stats.genres_ns));
+
+    if (helix_protocol) {
+      typename Messages::vector_type filtered = helix_receiver->filter(response);
+      bench.lap(kPhaseOblFilter);
+      helix_receiver->retrieve(filtered, out);
+      bench.lap(kPhaseRetrieve);
+    } else {
+      BlockMatrix<Bits> filtered = priority_receiver->filter(response);
+      bench.lap(kPhaseOblFilter);
+      out.resize(size_t(number_of_OT) * o.t);
+      for (int k = 0; k < number_of_OT; ++k) {
+        for (int j = 0; j < o.t; ++j) {
+          out[size_t(k) * o.t + j] = priority_receiver->retrieve(filtered, k, j);
+        }
+      }
+      bench.lap(kPhaseRetrieve);
+    }
+    double end_to_end = double(elapsed_ns(start));
+    if (expected != nullptr) {
+      for (int k = 0; k < number_of_OT; ++k) {
+        if (helix_protocol) {
+          bench.check(out[k] == expected[indices[k]]);
+          continue;
+        }
+        for (int j = 0; j < o.t; ++j) {
+          bench.check(out[size_t(k) * o.t + j] == expected[p[k][j]]);
+        }
+      }
+    }
+    bench.end();
+    if (rep >= bench.warmup()) {
+      net.round_trip_ns.push_back(round_trip);
+      net.transfer_ns.push_back(round_trip - double(stats.decode_ns) - double(stats.genres_ns));
+      net.end_to_end_ns.push_back(end_to_end);
+      net.decode_ns.push_back(double(stats.decode_ns));
+    }
+  }
+  return channel.send_frame(kWireBye);
+}
+
+void print_latency(const char* name, vector<double> ns) {
+  sort(ns.begin(), ns.end());
+  cout << " " << left << setw(22) << name << right << fixed << setprecision(4) << setw(12)
+       << ns.front() / 1e6 << setw(12) << PhaseBench::percentile(ns, 50) / 1e6 << setw(12)
+       << PhaseBench::percentile(ns, 99) / 1e6 << endl;
+}
+
+void print_net(const NetReport& net, const Channel& channel) {
+  cout << "\n Wire (bytes per batch, frame headers included)" << endl;
+  cout << " " << left << setw(10) << "Setup" << right << setw(14) << net.phase_bytes[kPhaseSetup]
+       << "  receiver -> sender (pad seed)" << endl;
+  cout << " " << left << setw(10) << "GenQuery" << right << setw(14) << net.phase_bytes[kPhaseGenQuery]
+       << "  receiver -> sender (query)" << endl;
+  cout << " " << left << setw(10) << "GenRes" << right << setw(14) << net.phase_bytes[kPhaseGenRes]
+       << "  sender -> receiver (response)" << endl;
+  cout << " Session: " << channel.bytes_sent() << " bytes sent, " << channel.bytes_received()
+       << " bytes received, 1 round trip per batch" << endl;
+
+  cout << "\n Latency (ms)" << setw(22) << "min" << setw(12) << "median" << setw(12) << "p99" << endl;
+  print_latency("Round trip", net.round_trip_ns);
+  print_latency("  sender decode", net.decode_ns);
+  print_latency("  transfer + wait", net.transfer_ns);
+  print_latency("End to end", net.end_to_end_ns);
+  cout.unsetf(ios::floatfield);
+  cout << setprecision(6);
+}
+
+int query(const string& endpoint, const QueryOptions& o) {
+  if (o.protocol != "helix" && o.protocol != "priority") {
+    cerr << "\n ** Error: --protocol must be helix or priority" << endl;
+    return 1;
+  }
+  if (!supported_bits(o.bits)) {
+    cerr << "\n ** Error: supported widths are 64, 128, 256, 512, 1024" << endl;
+    return 1;
+  }
+  Channel channel(connect_endpoint(endpoint));
+  if (!channel.is_open()) {
+    return 1;
+  }
+  PhaseBench bench(o.warmup, o.reps);
+  NetReport net;
+  net.n = 0;
+  memset(net.phase_bytes, 0, sizeof(net.phase_bytes));
+  bool ok = false;
+  switch (o.bits) {
+    case 64: ok = query_bits<64>(channel, o, bench, net); break;
+    case 128: ok = query_bits<128>(channel, o, bench, net); break;
+    case 256: ok = query_bits<256>(channel, o, bench, net); break;
+    case 512: ok = query_bits<512>(channel, o, bench, net); break;
+    case 1024: ok = query_bits<1024>(channel, o, bench, net); break;
+  }
+  if (!ok || net.round_trip_ns.empty()) {
+    cerr << "\n ** Error: session with " << endpoint << " failed" << endl;
+    return 1;
+  }
+  cout << "\n " << o.protocol << " OT over " << endpoint << ": n = " << net.n << ", batch = " << o.batch;
+  if (o.protocol == "priority") {
+    cout << ", t = " << o.t << ", query = " << o.query;
+  }
+  cout << ", " << o.bits << "-bit messages" << endl;
+  bench.report(cout, size_t(o.batch), double(net.n) * (o.bits / 8));
+  print_net(net, channel);
+  return bench.failures() == 0 ? 0 : 1;
+}
+
+// ---------------------------------------------------------------------------------------------
+// Scaling
+
+// One sender in the scaling report: the single-process sender (workers = 0) or a sharded one
+struct ScaleRun {
+  size_t workers;
+  vector<double> setup_ns;
+  vector<double> genres_ns;         // coordinator's wall time, worker transfer included
+  vector<double> worker_genres_ns;  // the slowest worker's compute alone
+  uint64_t worker_bytes;            // from the workers to the coordinator, one batch
+  bool match;                       // every response equal to the single-process sender's
+};
+
+double median(vector<double> samples) {
+  sort(samples.begin(), samples.end());
+  return PhaseBench::percentile(samples, 50);
+}
+
+// Runs the single-process sender and a sharded sender per worker count in counts, one after
+// the other on the same messages, pads and query each rep, in this process; the receiver's
+// query is made here and nothing goes to a receiver socket
+template <unsigned Bits>
+bool scale_bits(const QueryOptions& o, const vector<size_t>& counts, vector<ScaleRun>& runs) {
+  typedef BlockMessages<Bits> Messages;
+  const bool helix_protocol = o.protocol == "helix";
+  const int n = int(o.n), number_of_OT = o.batch;
+  const BlockVector<Bits> m = seeded_messages<Bits>(o.seed, 0, o.n);
+  WireShardHello session = {uint32_t(helix_protocol ? kWireHelix : kWirePriority), Bits, o.n, uint64_t(number_of_OT), 0, 0,
+                            o.seed, uint32_t(best_prg_kind()), 0};
+  vector<unique_ptr<WorkerSet> > sets;
+  vector<unique_ptr<ShardedSender<Bits> > > senders;
+  ScaleRun single = {0, {}, {}, {}, 0, true};
+  runs.assign(1, single);
+  for (size_t c = 0; c < counts.size(); ++c) {
+    ScaleRun run = {counts[c], {}, {}, {}, 0, true};
+    runs.push_back(run);
+    sets.push_back(unique_ptr<WorkerSet>(new WorkerSet()));
+    senders.push_back(unique_ptr<ShardedSender<Bits> >(new ShardedSender<Bits>(*sets.back())));
+    string reason;
+    if (!sets.back()->spawn(counts[c], "") || !senders.back()->open(session, reason)) {
+      cerr << "\n ** Error: cannot start " << counts[c] << " workers: " << reason << endl;
+      return false;
+    }
+  }
+
+  vector<int> indices;
+  vector<vector<int> > p;
+  if (helix_protocol) {
+    indices = helix::generateRandomIntegers(number_of_OT, n - 1);
+  } else {
+    p = priority::generateRandomVectors(o.t, number_of_OT, n);
+  }
+  BlockMatrix<Bits> expected, response;
+  for (int rep = 0; rep < o.warmup + o.reps; ++rep) {
+    const bool timed = rep >= o.warmup;
+    const PrgSeed pad_seed = random_prg_seed();
+    vector<uint64_t> share1;
+    PermutationSet w;
+    unique_ptr<FeistelPrp> prp;
+    if (helix_protocol) {
+      helix::Receiver<Messages> receiver(n, number_of_OT, Bits, pad_seed);
+      share1 = receiver.query(indices);
+    } else if (o.query == "prp") {
+      priority::Receiver<Messages> receiver(n, number_of_OT, o.t, Bits, pad_seed);
+      prp.reset(new FeistelPrp(receiver.query_prp(p)));
+    } else {
+      priority::Receiver<Messages> receiver(n, number_of_OT, o.t, Bits, pad_seed);
+      w = receiver.query(p);
+    }
+
+    Clock::time_point start = Clock::now();
+    double setup_ns;
+    if (helix_protocol) {
+      helix::Sender<Messages> sender(n, number_of_OT, Bits, pad_seed);
+      sender.setup();
+      setup_ns = double(elapsed_ns(start));
+      start = Clock::now();
+      expected = sender.respond(m, share1);
+    } else {
+      priority::Sender<Messages> sender(n, number_of_OT, Bits, pad_seed);
+      sender.setup();
+      setup_ns = double(elapsed_ns(start));
+      start = Clock::now();
+      expected = prp ? sender.respond(m, *prp) : sender.respond(m, w);
+    }
+    if (timed) {
+      runs[0].setup_ns.push_back(setup_ns);
+      runs[0].genres_ns.push_back(double(elapsed_ns(start)));
+    }
+
+    for (size_t c = 0; c < senders.size(); ++c) {
+      ScaleRun& run = runs[c + 1];
+      WireStats worker = {0, 0, 0};
+      const uint64_t received = sets[c]->bytes_received();
+      start = Clock::now();
+      bool ok = senders[c]->setup(pad_seed, worker);
+      setup_ns = double(elapsed_ns(start));
+      start = Clock::now();
+      if (ok && helix_protocol) {
+        ok = senders[c]->respond(share1, response, worker);
+      } else if (ok && prp) {
+        // Tabulating the PRP is part of GenRes, as it is for the single-process sender
+        PrpPositions positions(*prp, number_of_OT);
+        ok = senders[c]->respond(positions, response, worker);
+      } else if (ok) {
+        ok = senders[c]->respond(w, response, worker);
+      }
+      const double genres_ns = double(elapsed_ns(start));
+      if (!ok) {
+        return false;
+      }
+      run.match = run.match && response.rows() == expected.rows() && response.cols() == expected.cols() &&
+                  memcmp(response.data(), expected.data(), expected.size() * sizeof(Block<Bits>)) == 0;
+      if (timed) {
+        run.setup_ns.push_back(setup_ns);
+        run.genres_ns.push_back(genres_ns);
+        run.worker_genres_ns.push_back(double(worker.genres_ns));
+        run.worker_bytes = sets[c]->bytes_received() - received;
+      }
+    }
+  }
+  return true;
+}
+
+// scale: GenRes of the sharded sender against the single-process one, per worker count
+int scale(const QueryOptions& o, const vector<size_t>& counts) {
+  if (o.protocol != "helix" && o.protocol != "priority") {
+    cerr << "\n ** Error: --protocol must be helix or priority" << endl;
+    return 1;
+  }
+  if (!supported_bits(o.bits)) {
+    cerr << "\n ** Error: supported widths are 64, 128, 256, 512, 1024" << endl;
+    return 1;
+  }
+  if (o.n == 0 || o.n > uint64_t(1) << 30 || (o.protocol == "helix" && (o.n & (o.n - 1)) != 0)) {
+    cerr << "\n ** Error: --n must be in [1, 2^30], and a power of two for Helix OT" << endl;
+    return 1;
+  }
+  if (o.protocol == "priority" && (o.t <= 0 || uint64_t(o.t) > o.n)) {
+    cerr << "\n ** Error: t must be in [1, " << o.n << "]" << endl;
+    return 1;
+  }
+  vector<ScaleRun> runs;
+  bool ok = false;
+  switch (o.bits) {
+    case 64: ok = scale_bits<64>(o, counts, runs); break;
+    case 128: ok = scale_bits<128>(o, counts, runs); break;
+    case 256: ok = scale_bits<256>(o, counts, runs); break;
+    case 512: ok = scale_bits<512>(o, counts, runs); break;
+    case 1024: ok = scale_bits<1024>(o, counts, runs); break;
+  }
+  if (!ok) {
+    cerr << "\n ** Error: the sharded sender failed" << endl;
+    return 1;
+  }
+  cout << "\n " << o.protocol << " OT sender scaling: n = " << o.n << ", batch = " << o.batch;
+  if (o.protocol == "priority") {
+    cout << ", t = " << o.t << ", query = " << o.query;
+  }
+  cout << ", " << o.bits << "-bit messages, median of " << o.reps << " batches" << endl;
+  cout << " " << left << setw(9) << "Sender" << right << setw(8) << "Workers" << setw(9) << "Threads" << setw(12)
+       << "Setup ms" << setw(12) << "GenRes ms" << setw(12) << "Worker ms" << setw(10) << "GenRes x" << setw(9)
+       << "Total x" << setw(14) << "Worker bytes" << setw(7) << "Match" << endl;
+  const double single_genres = median(runs[0].genres_ns), single_total = median(runs[0].setup_ns) + single_genres;
+  bool all_match = true;
+  for (size_t c = 0; c < runs.size(); ++c) {
+    const ScaleRun& run = runs[c];
+    const double setup = median(run.setup_ns), genres = median(run.genres_ns);
+    const unsigned threads = c == 0 ? ThreadPool::global().size() : worker_threads(run.workers);
+    cout << " " << left << setw(9) << (c == 0 ? "single" : "sharded") << right << setw(8) << run.workers << setw(9)
+         << threads << fixed << setprecision(4) << setw(12) << setup / 1e6 << setw(12) << genres / 1e6 << setw(12)
+         << (c == 0 ? genres : median(run.worker_genres_ns)) / 1e6 << setprecision(2) << setw(10)
+         << single_genres / genres << setw(9) << single_total / (setup + genres) << setw(14) << run.worker_bytes
+         << setw(7) << (run.match ? "yes" : "NO") << endl;
+    cout.unsetf(ios::floatfield);
+    all_match = all_match && run.match;
+  }
+  cout << setprecision(6);
+  return all_match ? 0 : 1;
+}
+
+int main(int argc, char** argv) {
+  const string mode = argc > 1 ? argv[1] : "";
+  const bool has_endpoint = mode == "serve" || mode == "query" || mode == "shard";
+  if ((!has_endpoint && mode != "scale") || (has_endpoint && argc < 3)) {
+    cerr << "usage: " << argv[0] << " serve|query|shard <unix:path | tcp:host:port> [options]" << endl;
+    cerr << "       " << argv[0] << " scale [options]" << endl;
+    return 1;
+  }
+  // A peer that goes away must not kill the other process
+  signal(SIGPIPE, SIG_IGN);
+  const int first = has_endpoint ? 3 : 2;
+  string endpoint = has_endpoint ? argv[2] : "", db, shards, workers;
+  int sessions = 0;
+  QueryOptions o = {"helix", 4096, 10, 1, 128, "perm", 5, 1, 1, ""};
+  for (int a = first; a + 1 < argc; a += 2) {
+    string key = argv[a], value = argv[a + 1];
+    if (key == "--db") o.db = db = value;
+    else if (key == "--sessions" && (mode == "serve" || mode == "shard")) sessions = atoi(value.c_str());
+    else if (key == "--shards" && (mode == "serve" || mode == "scale")) shards = value;
+    else if (key == "--workers" && mode == "serve") workers = value;
+    else if (key == "--protocol") o.protocol = value;
+    else if (key == "--n") o.n = strtoull(value.c_str(), nullptr, 10);
+    else if (key == "--t") o.t = atoi(value.c_str());
+    else if (key == "--batch") o.batch = atoi(value.c_str());
+    else if (key == "--bits") o.bits = unsigned(atoi(value.c_str()));
+    else if (key == "--query") o.query = value;
+    else if (key == "--reps") o.reps = atoi(value.c_str());
+    else if (key == "--warmup") o.warmup = atoi(value.c_str());
+    else if (key == "--seed") o.seed = strtoull(value.c_str(), nullptr, 10);
+    else {
+      cerr << "unknown option " << key << endl;
+      return 1;
+    }
+  }
+  if ((argc - first) % 2 != 0) {
+    cerr << "missing value for " << argv[argc - 1] << endl;
+    return 1;
+  }
+  if (mode == "shard") {
+    return shard(endpoint, db, sessions);
+  }
+  if (mode == "serve") {
+    if (shards.empty() && workers.empty()) {
+      return serve(endpoint, db, sessions, nullptr);
+    }
+    WorkerSet set;
+    if (!shards.empty() && !workers.empty()) {
+      cerr << "\n ** Error: pass --shards or --workers, not both" << endl;
+      return 1;
+    }
+    if (!shards.empty() && atoi(shards.c_str()) <= 0) {
+      cerr << "\n ** Error: --shards must be at least 1" << endl;
+      return 1;
+    }
+    if (!(shards.empty() ? set.connect(workers) : set.spawn(size_t(atoi(shards.c_str())), db))) {
+      return 1;
+    }
+    cerr << "sharded over " << set.size() << " workers" << endl;
+    return serve(endpoint, db, sessions, &set);
+  }
+  if (o.reps <= 0) {
+    o.reps = 1;
+  }
+  if (o.warmup < 0) {
+    o.warmup = 0;
+  }
+  if (o.batch <= 0) {
+    o.batch = 1;
+  }
+  if (mode == "scale") {
+    // Worker counts, e.g. 1,2,4,8
+    vector<size_t> counts;
+    stringstream list(shards.empty() ? "1,2,4" : shards);
+    for (string count; getline(list, count, ',');) {
+      if (atoi(count.c_str()) <= 0) {
+        cerr << "\n ** Error: --shards takes a list of worker counts, e.g. 1,2,4" << endl;
+        return 1;
+      }
+      counts.push_back(size_t(atoi(count.c_str())));
+    }
+    return scale(o, counts);
+  }
+  return query(endpoint, o);
+}